@@ -0,0 +1,72 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    AllocationGuard.cpp
+
+  ==============================================================================
+*/
+
+#include "AllocationGuard.h"
+
+#if MAKAMIDI_TRACK_ALLOCATIONS
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+int& AllocationGuard::forbiddenDepth() noexcept
+{
+    static thread_local int depth = 0;
+    return depth;
+}
+
+unsigned long long& AllocationGuard::allocationCount() noexcept
+{
+    static thread_local unsigned long long count = 0;
+    return count;
+}
+
+static void* checkedAllocate(std::size_t size) noexcept
+{
+    ++AllocationGuard::allocationCount();
+
+    if (AllocationGuard::forbiddenDepth() > 0)
+    {
+        // report before aborting: stderr is unbuffered and does not allocate
+        std::fputs("MakaMIDI: heap allocation inside the realtime MIDI path\n", stderr);
+        std::abort();
+    }
+
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new(std::size_t size)
+{
+    if (auto* p = checkedAllocate(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    if (auto* p = checkedAllocate(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept    { return checkedAllocate(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept  { return checkedAllocate(size); }
+
+void operator delete(void* p) noexcept                                  { std::free(p); }
+void operator delete[](void* p) noexcept                                { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept                     { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept                   { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept           { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept         { std::free(p); }
+
+#endif
@@ -0,0 +1,49 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    AllocationGuard.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+// Build with -DMAKAMIDI_TRACK_ALLOCATIONS=ON to replace the global allocator with one
+// that aborts whenever the heap is touched inside a ScopedNoAllocation block.
+#ifndef MAKAMIDI_TRACK_ALLOCATIONS
+ #define MAKAMIDI_TRACK_ALLOCATIONS 0
+#endif
+
+#if MAKAMIDI_TRACK_ALLOCATIONS
+
+namespace AllocationGuard
+{
+    // number of nested ScopedNoAllocation blocks on the calling thread
+    int& forbiddenDepth() noexcept;
+
+    // heap allocations made by the calling thread so far (benchmarks read it around the code they measure)
+    unsigned long long& allocationCount() noexcept;
+}
+
+struct ScopedNoAllocation
+{
+    ScopedNoAllocation() noexcept   { ++AllocationGuard::forbiddenDepth(); }
+    ~ScopedNoAllocation() noexcept  { --AllocationGuard::forbiddenDepth(); }
+
+    ScopedNoAllocation(const ScopedNoAllocation&) = delete;
+    ScopedNoAllocation& operator=(const ScopedNoAllocation&) = delete;
+};
+
+#else
+
+struct ScopedNoAllocation
+{
+    ScopedNoAllocation() noexcept {}
+};
+
+#endif
@@ -0,0 +1,110 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    BendExpression.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+/*
+    @brief
+    glide and vibrato of the note sounding in mono mode, as an offset in pitch wheel units that the engine
+    adds to the user's wheel and to the note's correction:
+        - glide starts from the previous note's pitch and reaches the new note linearly in glideLength samples;
+        - vibrato is a sine of vibratoDepth wheel units and vibratoPeriod samples, starting from 0 with each
+          note that isn't played legato (legato notes keep its phase).
+    Positions are samples from the start of the current block; advance() moves on to the next block
+*/
+class BendExpression
+{
+public:
+    void setGlide(int samples) { glideLength = std::max(0, samples); }
+
+    void setVibrato(int depth, int periodSamples)
+    {
+        vibratoDepth = std::max(0, depth);
+        vibratoPeriod = std::max(0, periodSamples);
+    }
+
+    bool isEnabled() const noexcept { return glideLength > 0 || hasVibrato(); }
+
+    bool isPlaying() const noexcept { return playing; }
+
+    // the offset still changes: a glide in progress, or vibrato
+    bool isMoving() const noexcept { return playing && (glideTime < glideLength || hasVibrato()); }
+
+    // a note starts at samplePos, glideFrom wheel units away from where it ends up (0: no glide)
+    void noteOn(int samplePos, int glideFrom, bool legato) noexcept
+    {
+        glideStart = glideFrom;
+        glideTime = -(long long) samplePos;
+
+        if (!playing || !legato)
+            vibratoTime = -(long long) samplePos;
+
+        playing = true;
+    }
+
+    void noteOff() noexcept { playing = false; }
+
+    // what is left of the glide at samplePos
+    int getGlideOffset(int samplePos) const noexcept
+    {
+        const long long time = glideTime + samplePos;
+
+        if (!playing || glideStart == 0 || time >= glideLength)
+            return 0;
+
+        return (int) ((long long) glideStart * (glideLength - time) / glideLength);
+    }
+
+    int getOffset(int samplePos) const noexcept
+    {
+        if (!playing)
+            return 0;
+
+        int offset = getGlideOffset(samplePos);
+
+        if (hasVibrato())
+        {
+            constexpr double twoPi = 6.283185307179586;
+            const double phase = (double) ((vibratoTime + samplePos) % vibratoPeriod) / vibratoPeriod;
+            offset += (int) std::lround(vibratoDepth * std::sin(twoPi * phase));
+        }
+
+        return offset;
+    }
+
+    void advance(int numSamples) noexcept
+    {
+        glideTime = std::min(glideTime + numSamples, (long long) glideLength);
+
+        // the phase is all the vibrato needs
+        vibratoTime += numSamples;
+        if (vibratoPeriod > 0 && vibratoTime >= vibratoPeriod)
+            vibratoTime %= vibratoPeriod;
+    }
+
+private:
+    int glideLength = 0;
+    int vibratoDepth = 0;
+    int vibratoPeriod = 0;
+
+    bool playing = false;
+    int glideStart = 0;
+    // samples since the note started (glide) and since the vibrato started, at the start of the block
+    long long glideTime = 0;
+    long long vibratoTime = 0;
+
+    bool hasVibrato() const noexcept { return vibratoDepth > 0 && vibratoPeriod > 0; }
+};
@@ -0,0 +1,445 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    BlockProfiler.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <utility>
+#include "TraceBuffer.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+ #include <intrin.h>
+ #define MAKAMIDI_TIME_STAMP_COUNTER 1
+#elif defined(__x86_64__) || defined(__i386__)
+ #include <x86intrin.h>
+ #define MAKAMIDI_TIME_STAMP_COUNTER 1
+#endif
+
+/*
+    @brief
+    the cheapest clock of the CPU: the time stamp counter on x86, the virtual counter on ARM64,
+    steady_clock elsewhere. Ticks have no fixed length (both counters run at a constant rate on any
+    recent CPU, whatever its frequency); getTicksPerMicrosecond() measures it against steady_clock
+*/
+class CycleClock
+{
+public:
+    CycleClock() noexcept : originTicks(now()), originNanoseconds(steadyNanoseconds()) {}
+
+    static std::uint64_t now() noexcept
+    {
+       #if MAKAMIDI_TIME_STAMP_COUNTER
+        return __rdtsc();
+       #elif defined(__aarch64__)
+        std::uint64_t ticks;
+        asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+        return ticks;
+       #else
+        return (std::uint64_t) steadyNanoseconds();
+       #endif
+    }
+
+    static std::int64_t steadyNanoseconds() noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // the longer the clock has existed, the more precise: 1 ppm after a second
+    double getTicksPerMicrosecond() const noexcept
+    {
+       #if MAKAMIDI_TIME_STAMP_COUNTER || defined(__aarch64__)
+        const auto elapsed = steadyNanoseconds() - originNanoseconds;
+        const auto ticks = now() - originTicks;
+
+        if (elapsed > 0 && ticks > 0)
+            return (double) ticks * 1000.0 / (double) elapsed;
+       #endif
+        // steady_clock nanoseconds, and the best guess before any time has passed
+        return 1000.0;
+    }
+
+    // the steady_clock time of a reading of now(), in microseconds
+    double toSteadyMicroseconds(std::uint64_t ticks, double ticksPerMicrosecond) const noexcept
+    {
+        return (double) originNanoseconds / 1000.0 + (double) (std::int64_t) (ticks - originTicks) / ticksPerMicrosecond;
+    }
+
+private:
+    const std::uint64_t originTicks;
+    const std::int64_t originNanoseconds;
+};
+
+/*
+    @brief
+    counts of non-negative values in buckets 1/8 of a power of two wide (exact below 8), so anything from
+    a handful of events to 2^64 ticks fits in 4 KB. One thread adds without read-modify-write operations
+    or locks, any thread reads; a reader running at the same time sees counts at most one value behind
+*/
+class LogHistogram
+{
+public:
+    static constexpr int subBucketBits = 3;
+    static constexpr int subBuckets = 1 << subBucketBits;
+    static constexpr int numBuckets = (64 - subBucketBits + 1) * subBuckets;
+
+    // writer
+    void add(std::uint64_t value) noexcept
+    {
+        increment(buckets[(std::size_t) getBucket(value)], 1);
+        increment(count, 1);
+        increment(total, value);
+
+        if (value > maximum.load(std::memory_order_relaxed))
+            maximum.store(value, std::memory_order_relaxed);
+    }
+
+    // writer
+    void clear() noexcept
+    {
+        for (auto& bucket : buckets)
+            bucket.store(0, std::memory_order_relaxed);
+
+        count.store(0, std::memory_order_relaxed);
+        total.store(0, std::memory_order_relaxed);
+        maximum.store(0, std::memory_order_relaxed);
+    }
+
+    std::uint64_t getCount() const noexcept   { return count.load(std::memory_order_relaxed); }
+    std::uint64_t getTotal() const noexcept   { return total.load(std::memory_order_relaxed); }
+    std::uint64_t getMaximum() const noexcept { return maximum.load(std::memory_order_relaxed); }
+
+    // upper bound of the bucket holding the given fraction of the values, 0 when empty
+    std::uint64_t getPercentile(double fraction) const noexcept
+    {
+        const auto n = getCount();
+        const auto largest = getMaximum();
+        std::uint64_t seen = 0;
+
+        if (n == 0)
+            return 0;
+
+        for (int i = 0; i < numBuckets; ++i)
+        {
+            seen += buckets[(std::size_t) i].load(std::memory_order_relaxed);
+            if ((double) seen >= fraction * (double) n)
+                return std::min(getUpperBound(i), largest);
+        }
+
+        return largest;
+    }
+
+    static int getBucket(std::uint64_t value) noexcept
+    {
+        if (value < (std::uint64_t) subBuckets)
+            return (int) value;
+
+        const int bit = getHighestBit(value);
+        return (bit - subBucketBits + 1) * subBuckets + (int) ((value >> (bit - subBucketBits)) & (subBuckets - 1));
+    }
+
+    static std::uint64_t getUpperBound(int bucket) noexcept
+    {
+        if (bucket < subBuckets)
+            return (std::uint64_t) bucket;
+
+        const int shift = bucket / subBuckets - 1;
+        const auto lower = (std::uint64_t) (subBuckets + bucket % subBuckets) << shift;
+        return lower + (((std::uint64_t) 1 << shift) - 1);
+    }
+
+private:
+    std::array<std::atomic<std::uint64_t>, numBuckets> buckets {};
+    std::atomic<std::uint64_t> count { 0 }, total { 0 }, maximum { 0 };
+
+    // single writer: a plain load and store, no locked instruction
+    static void increment(std::atomic<std::uint64_t>& value, std::uint64_t amount) noexcept
+    {
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    static int getHighestBit(std::uint64_t value) noexcept
+    {
+        int bit = 0;
+        for (int shift = 32; shift > 0; shift /= 2)
+        {
+            if (value >> shift)
+            {
+                value >>= shift;
+                bit += shift;
+            }
+        }
+        return bit;
+    }
+};
+
+/*
+    @brief
+    how long one call of the engine's process() took, in CycleClock ticks, and the time of each stage:
+        - setup: output mode and channel changes, program switches, the MTS tuning, clearing the output;
+        - input: the input events, read, looked up in the table and written out one at a time;
+        - flush: glide and vibrato ramps, deferred and thinned pitch wheels;
+        - output: pre-bend scheduling and handing the buffer back.
+    Blocks that take a fast path (nothing to retune, only pitch wheels) have no stages
+*/
+struct BlockTiming
+{
+    enum Stage : int
+    {
+        setup,
+        input,
+        flush,
+        output,
+        numStages
+    };
+
+    std::uint64_t start;
+    std::uint32_t duration;
+    std::array<std::uint32_t, numStages> stages;
+    std::uint16_t inputEvents;
+    std::uint16_t outputEvents;
+
+    bool hasStages() const noexcept
+    {
+        return std::any_of(stages.begin(), stages.end(), [](std::uint32_t ticks) { return ticks != 0; });
+    }
+
+    static const char* getStageName(int stage) noexcept
+    {
+        static const char* const names[] = { "setup", "input", "flush", "output" };
+        return stage >= 0 && stage < numStages ? names[stage] : "?";
+    }
+
+    /*
+        @brief
+        the block and its stages as "complete" events of a Chrome trace (chrome://tracing, ui.perfetto.dev),
+        one per line, each followed by a comma: the JSON array format, whose closing bracket is optional.
+        Times are steady_clock microseconds. Returns the length written like snprintf (consumer side)
+    */
+    int format(char* text, std::size_t size, const CycleClock& clock, double ticksPerMicrosecond, int processId, int threadId) const noexcept
+    {
+        auto length = std::snprintf(text, size,
+                                    "{\"name\":\"process\",\"cat\":\"makamidi\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,"
+                                    "\"args\":{\"in\":%d,\"out\":%d}},\n",
+                                    clock.toSteadyMicroseconds(start, ticksPerMicrosecond), duration / ticksPerMicrosecond,
+                                    processId, threadId, inputEvents, outputEvents);
+        auto stageStart = start;
+
+        for (int stage = 0; stage < numStages && length > 0 && (std::size_t) length < size; ++stage)
+        {
+            if (stages[(std::size_t) stage] == 0)
+                continue;
+
+            length += std::snprintf(text + length, size - (std::size_t) length,
+                                    "{\"name\":\"%s\",\"cat\":\"makamidi\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d},\n",
+                                    getStageName(stage), clock.toSteadyMicroseconds(stageStart, ticksPerMicrosecond),
+                                    stages[(std::size_t) stage] / ticksPerMicrosecond, processId, threadId);
+            stageStart += stages[(std::size_t) stage];
+        }
+
+        return length;
+    }
+
+    // what a Chrome trace starts with: the bracket and the name of the track (consumer side)
+    static int formatTraceStart(char* text, std::size_t size, const char* name, int processId, int threadId) noexcept
+    {
+        return std::snprintf(text, size, "[\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+                             processId, threadId, name);
+    }
+};
+
+static_assert(sizeof(BlockTiming) == 32, "block timings are meant to stay small");
+
+/*
+    @brief
+    times every block the engine processes (see MidiProcessor::setProfiler), for a few reads of the
+    cycle counter per block. The audio thread fills lock-free histograms of the block time, of each
+    stage and of the events in and out, which any thread can summarize; with setTimeline(true) it also
+    queues every block's timing for a Chrome trace, drained by a background thread like the TraceBuffer
+*/
+class BlockProfiler
+{
+public:
+    // p50 and p99 are the upper bounds of their buckets: up to 1/8 above the true value
+    struct Distribution
+    {
+        std::uint64_t count = 0;
+        double mean = 0, p50 = 0, p99 = 0, max = 0;
+    };
+
+    /*
+        @brief
+        times one block: construct it before touching the buffer, call endStage() as each stage ends,
+        the destructor records it. With a null profiler it does nothing
+    */
+    template <typename BufferType>
+    class ScopedBlock
+    {
+    public:
+        ScopedBlock(BlockProfiler* owner, const BufferType& buffer) noexcept : profiler(owner), events(buffer)
+        {
+            if (profiler == nullptr)
+                return;
+
+            timing.inputEvents = countEvents(buffer);
+            timing.start = lastMark = CycleClock::now();
+        }
+
+        ~ScopedBlock()
+        {
+            if (profiler == nullptr)
+                return;
+
+            timing.duration = toDuration(CycleClock::now() - timing.start);
+            timing.outputEvents = countEvents(events);
+            profiler->record(timing);
+        }
+
+        void endStage(BlockTiming::Stage stage) noexcept
+        {
+            if (profiler == nullptr)
+                return;
+
+            const auto now = CycleClock::now();
+            timing.stages[(std::size_t) stage] = toDuration(now - lastMark);
+            lastMark = now;
+        }
+
+    private:
+        BlockProfiler* const profiler;
+        const BufferType& events;
+        BlockTiming timing {};
+        std::uint64_t lastMark = 0;
+
+        static std::uint16_t countEvents(const BufferType& buffer) noexcept
+        {
+            return (std::uint16_t) std::min(buffer.getNumEvents(), 0xffff);
+        }
+
+        static std::uint32_t toDuration(std::uint64_t ticks) noexcept
+        {
+            return (std::uint32_t) std::min(ticks, (std::uint64_t) 0xffffffffu);
+        }
+
+        ScopedBlock(const ScopedBlock&) = delete;
+        ScopedBlock& operator=(const ScopedBlock&) = delete;
+    };
+
+    explicit BlockProfiler(std::size_t timelineCapacity = 4096) : timeline(timelineCapacity) {}
+
+    // audio thread
+    void record(const BlockTiming& timing) noexcept
+    {
+        if (clearRequested.load(std::memory_order_acquire))
+        {
+            clearRequested.store(false, std::memory_order_relaxed);
+            blockTimes.clear();
+            for (auto& histogram : stageTimes)
+                histogram.clear();
+            inputEvents.clear();
+            outputEvents.clear();
+        }
+
+        blockTimes.add(timing.duration);
+        inputEvents.add(timing.inputEvents);
+        outputEvents.add(timing.outputEvents);
+
+        if (timing.hasStages())
+            for (int stage = 0; stage < BlockTiming::numStages; ++stage)
+                stageTimes[(std::size_t) stage].add(timing.stages[(std::size_t) stage]);
+
+        if (timelineEnabled.load(std::memory_order_relaxed))
+            timeline.push(timing);
+    }
+
+    // the histograms start again with the next block
+    void clear() noexcept { clearRequested.store(true, std::memory_order_release); }
+
+    // queues the timing of every block for drainTimeline()
+    void setTimeline(bool enabled) noexcept { timelineEnabled.store(enabled, std::memory_order_relaxed); }
+    bool isTimelineEnabled() const noexcept { return timelineEnabled.load(std::memory_order_relaxed); }
+
+    // times in microseconds
+    Distribution getBlockTimes() const noexcept           { return summarize(blockTimes, clock.getTicksPerMicrosecond()); }
+    Distribution getStageTimes(int stage) const noexcept  { return summarize(stageTimes[(std::size_t) stage], clock.getTicksPerMicrosecond()); }
+    Distribution getInputEvents() const noexcept          { return summarize(inputEvents, 1.0); }
+    Distribution getOutputEvents() const noexcept         { return summarize(outputEvents, 1.0); }
+
+    /*
+        @brief
+        the histograms in one line of text, for a stats panel or a log. Returns the length written like snprintf
+    */
+    int formatSummary(char* text, std::size_t size) const noexcept
+    {
+        const auto block = getBlockTimes();
+        const auto in = getInputEvents();
+        const auto out = getOutputEvents();
+
+        auto length = std::snprintf(text, size, "%llu blocks: mean %.2f us, p50 %.2f us, p99 %.2f us, max %.2f us;",
+                                    (unsigned long long) block.count, block.mean, block.p50, block.p99, block.max);
+
+        for (int stage = 0; stage < BlockTiming::numStages && length > 0 && (std::size_t) length < size; ++stage)
+        {
+            const auto times = getStageTimes(stage);
+            length += std::snprintf(text + length, size - (std::size_t) length, " %s p99 %.2f us max %.2f us;",
+                                    BlockTiming::getStageName(stage), times.p99, times.max);
+        }
+
+        if (length > 0 && (std::size_t) length < size)
+            length += std::snprintf(text + length, size - (std::size_t) length, " events in p50 %.0f p99 %.0f max %.0f, out p50 %.0f p99 %.0f max %.0f\n",
+                                    in.p50, in.p99, in.max, out.p50, out.p99, out.max);
+
+        return length;
+    }
+
+    // consumer: calls function(timing) for every block queued so far, returns how many
+    template <typename Function>
+    std::size_t drainTimeline(Function&& function) { return timeline.drain(std::forward<Function>(function)); }
+
+    // blocks missing from the timeline since the last call
+    std::uint64_t takeDroppedTimeline() noexcept { return timeline.takeDropped(); }
+
+    const CycleClock& getClock() const noexcept { return clock; }
+
+private:
+    const CycleClock clock;
+
+    LogHistogram blockTimes;
+    std::array<LogHistogram, BlockTiming::numStages> stageTimes;
+    LogHistogram inputEvents, outputEvents;
+    std::atomic<bool> clearRequested { false };
+
+    BasicTraceBuffer<BlockTiming> timeline;
+    std::atomic<bool> timelineEnabled { false };
+
+    static Distribution summarize(const LogHistogram& histogram, double unitsPerValue) noexcept
+    {
+        Distribution distribution;
+        distribution.count = histogram.getCount();
+
+        if (distribution.count > 0)
+        {
+            distribution.mean = (double) histogram.getTotal() / (double) distribution.count / unitsPerValue;
+            distribution.p50 = (double) histogram.getPercentile(0.5) / unitsPerValue;
+            distribution.p99 = (double) histogram.getPercentile(0.99) / unitsPerValue;
+            distribution.max = (double) histogram.getMaximum() / unitsPerValue;
+        }
+
+        return distribution;
+    }
+};
@@ -0,0 +1,130 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    DelayQueue.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "MidiEventBuffer.h"
+
+/*
+    @brief
+    FIFO of raw MIDI messages waiting for their output time, for the engine's lookahead. A ring of
+    bytes sized once in reserve(): push and pop never allocate, a message that doesn't fit is refused.
+    Messages are never split: when one doesn't fit before the end of the ring, the rest of the ring is
+    skipped and it starts again at the beginning.
+
+    Record layout: uint16 size, int64 time, then the bytes.
+*/
+class DelayQueue
+{
+public:
+    void reserve(std::size_t capacityBytes)
+    {
+        storage.assign(capacityBytes, 0);
+        clear();
+    }
+
+    void clear() noexcept { head = tail = used = 0; }
+
+    bool isEmpty() const noexcept { return used == 0; }
+
+    // times must be pushed in non-decreasing order
+    bool push(long long time, const std::uint8_t* data, int numBytes) noexcept
+    {
+        const std::size_t recordSize = headerSize + (std::size_t) numBytes;
+        const std::size_t capacity = storage.size();
+        const std::size_t waste = capacity - tail < recordSize ? capacity - tail : 0;
+
+        if (numBytes <= 0 || numBytes >= (int) wrapMarker || used + waste + recordSize > capacity)
+            return false;
+
+        if (waste > 0)
+        {
+            // tells the reader to go back to the beginning (it also does when there is no room for the marker)
+            if (waste >= sizeof(std::uint16_t))
+                writeSize(tail, wrapMarker);
+            used += waste;
+            tail = 0;
+        }
+
+        writeSize(tail, (std::uint16_t) numBytes);
+        std::memcpy(storage.data() + tail + sizeof(std::uint16_t), &time, sizeof(time));
+        std::memcpy(storage.data() + tail + headerSize, data, (std::size_t) numBytes);
+
+        // a record that ends the ring exactly leaves no room for a wrap marker: the next one starts at the beginning
+        tail += recordSize;
+        if (tail == capacity)
+            tail = 0;
+
+        used += recordSize;
+        return true;
+    }
+
+    // the queue must not be empty
+    long long frontTime() noexcept
+    {
+        skipWrap();
+        long long time;
+        std::memcpy(&time, storage.data() + head + sizeof(std::uint16_t), sizeof(time));
+        return time;
+    }
+
+    MidiEvent front() noexcept
+    {
+        skipWrap();
+        return { storage.data() + head + headerSize, readSize(head), 0 };
+    }
+
+    void pop() noexcept
+    {
+        skipWrap();
+        const std::size_t recordSize = headerSize + readSize(head);
+        head += recordSize;
+        used -= recordSize;
+
+        if (used == 0)
+            head = tail = 0;
+    }
+
+private:
+    static constexpr std::size_t headerSize = sizeof(std::uint16_t) + sizeof(long long);
+    static constexpr std::uint16_t wrapMarker = 0xffff;
+
+    std::vector<std::uint8_t> storage;
+    std::size_t head = 0, tail = 0, used = 0;
+
+    void skipWrap() noexcept
+    {
+        const std::size_t remaining = storage.size() - head;
+
+        if (remaining < headerSize || readSize(head) == wrapMarker)
+        {
+            used -= remaining;
+            head = 0;
+        }
+    }
+
+    std::uint16_t readSize(std::size_t offset) const noexcept
+    {
+        std::uint16_t size;
+        std::memcpy(&size, storage.data() + offset, sizeof(size));
+        return size;
+    }
+
+    void writeSize(std::size_t offset, std::uint16_t size) noexcept
+    {
+        std::memcpy(storage.data() + offset, &size, sizeof(size));
+    }
+};
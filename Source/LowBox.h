@@ -26,7 +26,7 @@ public:
     std::unique_ptr<juce::ToggleButton> toggle;
     std::unique_ptr<juce::ComboBox> alteration;
 
-    LowBox(juce::AudioProcessorValueTreeState &apvts, int i)
+    LowBox(int i)
     {
         index = i;
         note = std::make_unique<ComboBox>();
@@ -49,17 +49,6 @@ public:
         toggle->onClick = [this] () { toggleClicked(); };
         toggle->setToggleState(false, juce::NotificationType::dontSendNotification);
 
-        String ts = String("Toggle ");
-        ts.append(String(i), 2);
-        String ns = String("Note ");
-        ns.append(String(i), 2);
-        String as = String("Alteration ");
-        as.append(String(i), 2);
-
-        toggleAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ButtonAttachment>(apvts, ts, *toggle);
-        noteAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ComboBoxAttachment>(apvts, ns, *note);
-        alterationAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ComboBoxAttachment>(apvts, as, *alteration);
-        
         addAndMakeVisible(*note);
         addAndMakeVisible(*alteration);
         addAndMakeVisible(*toggle);
@@ -93,7 +82,7 @@ public:
     // change the content of the box
     void setAlteration(int noteNum, int newAlteration)
     {
-        note->setSelectedId(noteNum-10);
+        note->setSelectedId(noteNum-10, juce::NotificationType::dontSendNotification);
         /*        // This is the old way of setting the alteration text, now it uses a ComboBox ID
         String * stringAlt = new String();
         if (newAlteration > 0)
@@ -133,44 +122,35 @@ public:
     }
 
 
-private:
-    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> noteAttachment;
-    std::unique_ptr < juce::AudioProcessorValueTreeState::ComboBoxAttachment> alterationAttachment; 
-    std::unique_ptr < juce::AudioProcessorValueTreeState::ButtonAttachment> toggleAttachment;
-
-    int index;
-
-    const juce::StringArray midiNotes = listMIDINotes();
-    const juce::StringArray alterationsInCommas = listAlterationsInCommas();
-
-    juce::StringArray listAlterationsInCommas()
+    // item lists shared by every box
+    static const juce::StringArray& listAlterationsInCommas()
     {
-        StringArray output;
-        output.add("");
-        for (int i = -9; i < 10; i++)
-        {
-            String* s = new String();
-            if (i > 0)
-                s->append("+", 1);
-            s->append(String(i), 2);
-            output.add(*s);
-        }
+        static const juce::StringArray output = [] {
+            StringArray list;
+            list.add("");
+            for (int i = -9; i < 10; i++)
+                list.add(i > 0 ? "+" + String(i) : String(i));
+            return list;
+        }();
         return output;
     }
 
-    juce::StringArray listMIDINotes()
+    static const juce::StringArray& listMIDINotes()
     {
-        std::vector<String> noteNames = {
-            "C", "C#/Db", "D", "D#/Eb", "E", "F", "F#/Gb", "G", "G#/Ab", "A", "A#/Bb", "B"
-        };
-
-        StringArray output;
-        output.add("");
-        for (int i = 0; i < 116; i++) {
-            output.add(noteNames[i % 12] + String(std::floor(i / 12)));
-        }
-
+        static const juce::StringArray output = [] {
+            StringArray list;
+            list.add("");
+            for (int i = 0; i < 116; i++)
+                list.add(getNoteNames()[(size_t) (i % 12)] + String(i / 12));
+            return list;
+        }();
         return output;
     }
 
+private:
+    int index;
+
+    const juce::StringArray& midiNotes = listMIDINotes();
+    const juce::StringArray& alterationsInCommas = listAlterationsInCommas();
+
 };
\ No newline at end of file
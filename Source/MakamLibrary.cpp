@@ -0,0 +1,241 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    MakamLibrary.cpp
+
+  ==============================================================================
+*/
+
+#include "MakamLibrary.h"
+
+static juce::PropertiesFile::Options getSettingsOptions()
+{
+    juce::PropertiesFile::Options options;
+    options.applicationName = "MakaMIDI";
+    options.filenameSuffix = ".settings";
+    options.folderName = "MakaMIDI";
+    options.osxLibrarySubFolder = "Application Support";
+    return options;
+}
+
+//==============================================================================
+MakamLibrary::MakamLibrary()
+    : juce::Thread("MakaMIDI library"),
+      settings(getSettingsOptions()),
+      index(std::make_shared<const Index>())
+{
+    // the MakamData folder installed next to the plugin, and the user's own scale folder
+    const auto pluginRoot = juce::File::getSpecialLocation(juce::File::currentExecutableFile)
+        .getParentDirectory().getParentDirectory().getParentDirectory();
+    defaultDirectories.add(pluginRoot.getChildFile("MakamData"));
+    defaultDirectories.add(pluginRoot.getParentDirectory().getChildFile("MakamData"));
+    defaultDirectories.add(settings.getFile().getParentDirectory().getChildFile("Scales"));
+
+    juce::StringArray savedDirectories;
+    savedDirectories.addLines(settings.getValue("userDirectories"));
+    for (auto& path : savedDirectories)
+        if (juce::File::isAbsolutePath(path))
+            userDirectories.addIfNotAlreadyThere(juce::File(path));
+
+    startThread();
+}
+
+MakamLibrary::~MakamLibrary()
+{
+    stopThread(4000);
+}
+
+std::shared_ptr<const MakamLibrary::Index> MakamLibrary::getIndex() const
+{
+    const juce::ScopedLock sl(lock);
+    return index;
+}
+
+const MakamEntry* MakamLibrary::findEntry(const Index& entries, const juce::String& name) const
+{
+    for (auto& entry : entries)
+        if (entry.isValid() && entry.name == name)
+            return &entry;
+    return nullptr;
+}
+
+juce::Array<juce::File> MakamLibrary::getDirectories() const
+{
+    const juce::ScopedLock sl(lock);
+    auto directories = defaultDirectories;
+    directories.addArray(userDirectories);
+    return directories;
+}
+
+void MakamLibrary::addUserDirectory(const juce::File& directory)
+{
+    {
+        const juce::ScopedLock sl(lock);
+        if (!userDirectories.addIfNotAlreadyThere(directory))
+            return;
+    }
+
+    saveUserDirectories();
+    rescan();
+}
+
+void MakamLibrary::removeUserDirectory(const juce::File& directory)
+{
+    {
+        const juce::ScopedLock sl(lock);
+        userDirectories.removeAllInstancesOf(directory);
+    }
+
+    saveUserDirectories();
+    rescan();
+}
+
+void MakamLibrary::saveUserDirectories()
+{
+    juce::StringArray paths;
+    {
+        const juce::ScopedLock sl(lock);
+        for (auto& directory : userDirectories)
+            paths.add(directory.getFullPathName());
+    }
+
+    settings.setValue("userDirectories", paths.joinIntoString("\n"));
+    settings.saveIfNeeded();
+}
+
+void MakamLibrary::rescan()
+{
+    notify();
+}
+
+// "Midi makam notation - Hicaz Humayun.csv" -> "Hicaz Humayun"
+juce::String MakamLibrary::nameFromFile(const juce::File& file)
+{
+    auto name = file.getFileNameWithoutExtension();
+    if (name.contains(" - "))
+        name = name.fromLastOccurrenceOf(" - ", false, false);
+    return name.trim();
+}
+
+//==============================================================================
+void MakamLibrary::run()
+{
+    while (!threadShouldExit())
+    {
+        if (scan())
+            sendChangeMessage();
+
+        wait(pollIntervalMs);
+    }
+}
+
+// re-indexes what changed since the previous scan, returns true if the index changed
+bool MakamLibrary::scan()
+{
+    const auto previous = getIndex();
+    auto next = std::make_shared<Index>();
+    bool changed = false;
+
+    for (auto& directory : getDirectories())
+    {
+        if (!directory.isDirectory())
+            continue;
+
+        for (const auto& item : juce::RangedDirectoryIterator(directory, false, "*.csv;*" + juce::String(CompiledTuning::fileExtension)))
+        {
+            if (threadShouldExit())
+                return false;
+
+            const auto& file = item.getFile();
+
+            // files found through two folders are only indexed once
+            if (std::any_of(next->begin(), next->end(), [&](const MakamEntry& e) { return e.file == file; }))
+                continue;
+
+            auto unchanged = std::find_if(previous->begin(), previous->end(), [&](const MakamEntry& e) {
+                return e.file == file
+                    && e.modificationTime == item.getModificationTime()
+                    && e.fileSize == item.getFileSize();
+            });
+
+            if (unchanged != previous->end())
+            {
+                next->push_back(*unchanged);
+            }
+            else
+            {
+                next->push_back(load(file));
+                changed = true;
+            }
+        }
+    }
+
+    // removed files
+    if (next->size() != previous->size())
+        changed = true;
+
+    if (!changed)
+        return false;
+
+    std::sort(next->begin(), next->end(), [](const MakamEntry& a, const MakamEntry& b) {
+        if (a.family != b.family)
+            return a.family.compareNatural(b.family) < 0;
+        return a.name.compareNatural(b.name) < 0;
+    });
+
+    const juce::ScopedLock sl(lock);
+    index = std::move(next);
+    return true;
+}
+
+MakamEntry MakamLibrary::load(const juce::File& file) const
+{
+    MakamEntry entry;
+    entry.file = file;
+    entry.modificationTime = file.getLastModificationTime();
+    entry.fileSize = file.getSize();
+    entry.name = nameFromFile(file);
+
+    juce::MemoryBlock contents;
+    if (!file.loadFileAsData(contents))
+    {
+        entry.diagnostics.push_back({ ScaleDiagnostic::Severity::error, 0, "failed to open file" });
+        return entry;
+    }
+
+    auto result = ScaleParser::parse(contents.getData(), contents.getSize());
+    entry.diagnostics = std::move(result.diagnostics);
+
+    // a scale with errors stays in the index, without a table, so that the problem can be shown
+    if (std::any_of(entry.diagnostics.begin(), entry.diagnostics.end(),
+                    [](const ScaleDiagnostic& d) { return d.severity == ScaleDiagnostic::Severity::error; }))
+        return entry;
+
+    for (int i = 0; i < TuningTable::numNotes; ++i)
+    {
+        if (result.table.isExcluded(i))
+            continue;
+        if (entry.lowestNote < 0)
+            entry.lowestNote = i;
+        entry.highestNote = i;
+    }
+
+    const auto name = juce::String(result.getMetadata("name"));
+    if (name.isNotEmpty())
+        entry.name = name;
+
+    // the family is the first word of the name unless the file says otherwise (Hicaz Humayun -> Hicaz)
+    const auto family = juce::String(result.getMetadata("family"));
+    entry.family = family.isNotEmpty() ? family : entry.name.upToFirstOccurrenceOf(" ", false, false);
+
+    const auto tonic = juce::String(result.getMetadata("tonic"));
+    entry.tonic = tonic.isNotEmpty() ? juce::jlimit(0, TuningTable::numNotes - 1, tonic.getIntValue()) : entry.lowestNote;
+
+    entry.table = pool->intern(result.table);
+    return entry;
+}
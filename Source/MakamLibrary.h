@@ -0,0 +1,96 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    MakamLibrary.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+#include "ScaleParser.h"
+#include "TuningPool.h"
+#include "TuningTable.h"
+
+/*
+    @brief
+    one scale file of the library, parsed and validated
+*/
+struct MakamEntry
+{
+    juce::String name;          // "Hicaz Humayun"
+    juce::String family;        // "Hicaz"
+    juce::File file;
+    juce::Time modificationTime;
+    juce::int64 fileSize = 0;
+
+    int tonic = -1;             // "# tonic:" metadata, or the lowest note of the scale
+    int lowestNote = -1;        // range of the notes that are part of the scale
+    int highestNote = -1;
+
+    std::shared_ptr<const TuningTable> table;
+    std::vector<ScaleDiagnostic> diagnostics;
+
+    bool isValid() const { return table != nullptr; }
+};
+
+/*
+    @brief
+    process-wide index of the makam scales found in MakamData and in the user's scale folders.
+
+    A background thread parses every CSV/.mkt file, keeps the index sorted by family and name,
+    and polls the folders so that added, changed or removed files are re-indexed incrementally.
+    Listeners are told about changes on the message thread. Switching makam then only means
+    publishing one of the prebuilt tables.
+
+    Shared between plugin instances through juce::SharedResourcePointer<MakamLibrary>.
+*/
+class MakamLibrary : public juce::ChangeBroadcaster,
+                     private juce::Thread
+{
+public:
+    using Index = std::vector<MakamEntry>;
+
+    MakamLibrary();
+    ~MakamLibrary() override;
+
+    std::shared_ptr<const Index> getIndex() const;
+
+    // the valid entry whose name matches, nullptr if none
+    const MakamEntry* findEntry(const Index& index, const juce::String& name) const;
+
+    juce::Array<juce::File> getDirectories() const;
+    void addUserDirectory(const juce::File& directory);
+    void removeUserDirectory(const juce::File& directory);
+
+    // asks the background thread for an immediate rescan
+    void rescan();
+
+    static juce::String nameFromFile(const juce::File& file);
+
+private:
+    void run() override;
+    bool scan();
+    MakamEntry load(const juce::File& file) const;
+    void saveUserDirectories();
+
+    static constexpr int pollIntervalMs = 2000;
+
+    juce::Array<juce::File> defaultDirectories;
+    juce::Array<juce::File> userDirectories;
+    juce::PropertiesFile settings;
+
+    // scales are interned, so that instances using the same makam share its table
+    juce::SharedResourcePointer<TuningPool> pool;
+
+    mutable juce::CriticalSection lock;
+    std::shared_ptr<const Index> index;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MakamLibrary)
+};
@@ -0,0 +1,130 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    MidiEventBuffer.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// one raw MIDI message, viewed in place: the bytes belong to the buffer it comes from
+struct MidiEvent
+{
+    const std::uint8_t* data;
+    int numBytes;
+    int samplePosition;
+};
+
+/*
+    @brief
+    time ordered list of raw MIDI messages for hosts without JUCE. Same storage layout and
+    interface subset as juce::MidiBuffer (int32 sample position, uint16 size, then the bytes),
+    so the engine runs unchanged on either. Nothing is allocated once the storage is reserved.
+*/
+class MidiEventBuffer
+{
+public:
+    class Iterator
+    {
+    public:
+        explicit Iterator(const std::uint8_t* position) noexcept : p(position) {}
+
+        MidiEvent operator*() const noexcept
+        {
+            std::int32_t samplePosition;
+            std::uint16_t numBytes;
+            std::memcpy(&samplePosition, p, sizeof(samplePosition));
+            std::memcpy(&numBytes, p + sizeof(samplePosition), sizeof(numBytes));
+            return { p + headerSize, numBytes, samplePosition };
+        }
+
+        Iterator& operator++() noexcept
+        {
+            std::uint16_t numBytes;
+            std::memcpy(&numBytes, p + sizeof(std::int32_t), sizeof(numBytes));
+            p += headerSize + numBytes;
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const noexcept { return p == other.p; }
+        bool operator!=(const Iterator& other) const noexcept { return p != other.p; }
+
+    private:
+        const std::uint8_t* p;
+    };
+
+    static constexpr std::size_t headerSize = sizeof(std::int32_t) + sizeof(std::uint16_t);
+
+    Iterator begin() const noexcept { return Iterator(data.data()); }
+    Iterator end() const noexcept   { return Iterator(data.data() + data.size()); }
+
+    bool isEmpty() const noexcept   { return data.empty(); }
+    void clear() noexcept           { data.clear(); lastSamplePosition = 0; }
+
+    // reserves storage for the given number of bytes (headers included)
+    void ensureSize(std::size_t minimumBytes)  { data.reserve(minimumBytes); }
+
+    void swapWith(MidiEventBuffer& other) noexcept
+    {
+        data.swap(other.data);
+        std::swap(lastSamplePosition, other.lastSamplePosition);
+    }
+
+    int getNumEvents() const noexcept
+    {
+        int n = 0;
+        for (auto it = begin(); it != end(); ++it)
+            ++n;
+        return n;
+    }
+
+    /*
+        @brief
+        adds a message after any other message at the same sample position. Appending in time order,
+        as the engine does, is O(1); earlier positions are inserted in place
+    */
+    void addEvent(const std::uint8_t* bytes, int numBytes, int samplePosition)
+    {
+        if (numBytes <= 0)
+            return;
+
+        const auto offset = isEmpty() || samplePosition >= lastSamplePosition ? data.size() : findEventAfter(samplePosition);
+        const auto size = (std::uint16_t) numBytes;
+        const auto position = (std::int32_t) samplePosition;
+
+        data.insert(data.begin() + (std::ptrdiff_t) offset, headerSize + size, 0);
+        std::memcpy(data.data() + offset, &position, sizeof(position));
+        std::memcpy(data.data() + offset + sizeof(position), &size, sizeof(size));
+        std::memcpy(data.data() + offset + headerSize, bytes, size);
+
+        if (offset + headerSize + size == data.size())
+            lastSamplePosition = samplePosition;
+    }
+
+    void addEvent(const MidiEvent& event) { addEvent(event.data, event.numBytes, event.samplePosition); }
+
+    // the raw storage, in the layout described above
+    std::vector<std::uint8_t> data;
+
+private:
+    int lastSamplePosition = 0;
+
+    std::size_t findEventAfter(int samplePosition) const noexcept
+    {
+        for (auto it = begin(); it != end(); ++it)
+            if ((*it).samplePosition > samplePosition)
+                return (std::size_t) ((*it).data - headerSize - data.data());
+        return data.size();
+    }
+};
@@ -15,152 +15,1513 @@
 
 #pragma once
 
-// #include "JuceHeader.h"
-// Changed from Projucer to CMake build system
-#include <juce_audio_processors/juce_audio_processors.h>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include "AllocationGuard.h"
+#include "BendExpression.h"
+#include "BlockProfiler.h"
+#include "DelayQueue.h"
+#include "MidiEventBuffer.h"
+#include "MidiTuningStandard.h"
+#include "PitchBendTable.h"
+#include "TraceBuffer.h"
+#include "TuningBank.h"
+#include "TuningTable.h"
+#include "UniversalMidiPacket.h"
+#include "VoiceAllocator.h"
 
-using namespace juce;
+/*
+    @brief
+    how retuned notes reach the synth:
+        - mono: the incoming channel, one note at a time (the original behaviour);
+        - mpe: one member channel per note (2 to 16), the wheel on master channel 1;
+        - multiChannel: one channel per note over all 16, for multitimbral synths without MPE;
+        - mts: notes and wheel untouched, the synth retuned by MIDI Tuning Standard SysEx whenever the
+          table changes (only the keys whose tuning differs are sent);
+        - midi2: MIDI 2.0 Universal MIDI Packets with per-note pitch (see UniversalMidiPacket.h), on the
+          incoming channel and without any pitch bend. Only for hosts of the core that speak UMP: the
+          output buffer then holds 8-byte packets instead of MIDI 1.0 messages.
+    The first four match the plugin's "Output Mode" choices, whose hosts only take MIDI 1.0.
+*/
+enum class OutputMode
+{
+    mono,
+    mpe,
+    multiChannel,
+    mts,
+    midi2
+};
 
-class MidiProcessor
+/*
+    @brief
+    the retuning engine. Plain C++: BufferType is MidiEventBuffer, or juce::MidiBuffer in the plugin
+    (same layout, same interface subset), so the plugin reads the host's buffer and writes the result back into it
+*/
+template <typename BufferType>
+class BasicMidiProcessor
 {
 public:
-    int process(MidiBuffer& midiMessages, int *pitchWheelValue, int *pitchCorrection, const juce::Array<int> &alterations, int *activeNoteNumber)
+    /*
+        @brief
+        reserves the engine's buffers up front, so that process() never has to grow them on the audio thread.
+        The caller's buffer receives the output: give it getOutputCapacity() bytes, or it may grow in process()
+    */
+    void prepare(int samplesPerBlock)
+    {
+        // worst case: a pitch wheel message bends every voice in multi-channel mode
+        const int maxEvents = std::max(minReservedEvents, samplesPerBlock) * maxOutputEventsPerInput;
+        reservedBytes = (std::size_t) maxEvents * bytesPerEvent;
+        processedBuffer.ensureSize(reservedBytes);
+
+        // the lookahead holds a few blocks of ordinary traffic; what doesn't fit goes out undelayed
+        delayedEvents.reserve(reservedBytes * 2);
+        preBends.reserve(reservedBytes / 2);
+    }
+
+    /*
+        @brief
+        selects the correction table matching the synth's pitch bend range (an index into PitchBend::ranges)
+        and schedules the RPN 0 messages that configure the synth accordingly
+    */
+    void setBendRange(int rangeIndex)
+    {
+        bendRangeIndex = std::clamp(rangeIndex, 0, (int) PitchBend::ranges.size() - 1);
+        bendCorrections = PitchBend::getCorrections(bendRangeIndex);
+        expression.setVibrato(centsToWheel(vibratoDepthCents), vibratoPeriodSamples);
+        bendRangeSetupPending = true;
+    }
+
+    int getBendRange() const { return bendRangeIndex; }
+
+    // bytes the output of a block can take at most, headers included (after prepare())
+    std::size_t getOutputCapacity() const noexcept { return reservedBytes; }
+
+    /*
+        @brief
+        makam switching: Program Change n and keyswitch note (keyswitchBase + n) select program n of the bank,
+        program -1 is the editable table. A negative keyswitchBase disables keyswitches
+    */
+    void setSwitching(bool useProgramChange, int newKeyswitchBase)
+    {
+        programChangeSwitching = useProgramChange;
+        keyswitchBase = newKeyswitchBase;
+    }
+
+    // switches program at the start of the next block (host or GUI request), on every channel
+    void requestProgram(int program)
+    {
+        pendingProgram = program;
+        pendingChannelPrograms.fill(program);
+        hasPendingChannelPrograms = true;
+    }
+
+    /*
+        @brief
+        independent channels (mono mode): each input channel keeps its own wheel, sounding note, correction,
+        makam and melody direction, so two players or the zones of a split keyboard on different channels
+        don't disturb each other. Program Change and keyswitches then switch only their channel; the state
+        passed to process() is left to the GUI and host requests. Takes effect at the next block, ending the
+        notes sounding. Glide and vibrato only play on a shared stream
+    */
+    void setIndependentChannels(bool shouldBeIndependent) { requestedIndependentChannels = shouldBeIndependent; }
+
+    // the makam of one input channel (1 to 16) when channels are independent, from the next block: zones set up by the host
+    void requestChannelProgram(int channel, int program)
+    {
+        if (channel >= 1 && channel <= 16)
+        {
+            pendingChannelPrograms[(std::size_t) (channel - 1)] = program;
+            hasPendingChannelPrograms = true;
+        }
+    }
+
+    // exclusive mode: notes that are not in the scale are dropped
+    void setExclusive(bool shouldBeExclusive) { exclusive = shouldBeExclusive; }
+
+    /*
+        @brief
+        notes take their ascending or descending alteration (see TuningTable) by the direction of the melody,
+        which only turns when a note goes back more than semitones below the highest note reached since
+        the melody last turned up (or above the lowest one since it last turned down). 0: any step back turns it
+    */
+    void setDirectionHysteresis(int semitones) { directionHysteresis = std::max(0, semitones); }
+
+    // changes output mode at the start of the next block, ending the notes sounding in the current one
+    void setOutputMode(OutputMode mode) { requestedOutputMode = mode; }
+
+    OutputMode getOutputMode() const { return outputMode; }
+
+    /*
+        @brief
+        thins the pitch wheel stream: at most one wheel message per minimumInterval samples on each channel,
+        and only when it moves by minimumStep or more (1 keeps the full 14 bits). The last value held back
+        is always sent, at the latest at the end of the block. Bends that retune notes are never thinned
+    */
+    void setWheelThinning(int minimumInterval, int minimumStep)
     {
+        wheelInterval = std::max(0, minimumInterval);
+        wheelStep = std::clamp(minimumStep, 1, 8192);
+    }
+
+    /*
+        @brief
+        pre-bend: every message is delayed by delaySamples, except the bends that retune a note, which
+        keep their time and so reach the synth delaySamples before their NoteOn (no scoop at the attack
+        on synths that apply a bend only to notes already started). The host must be told about the
+        latency. Needs the block length in process(); 0 turns it off
+    */
+    void setPreBend(int delaySamples) { requestedPreBendDelay = std::max(0, delaySamples); }
+
+    int getLatencySamples() const { return preBendDelay; }
+
+    /*
+        @brief
+        mono mode expression: glide between legato notes over glideSamples, and vibrato of vibratoCents
+        with a period of vibratoPeriod samples, played as pitch wheel ramps on top of the user's wheel and
+        the note's correction. The ramps are drawn once per minimumInterval samples at most, whatever the
+        settings, so they can't flood the MIDI stream. Needs the block length in process(); 0 turns it off
+    */
+    void setExpression(int glideSamples, int vibratoCents, int vibratoPeriod, int minimumInterval)
+    {
+        expression.setGlide(glideSamples);
+        vibratoDepthCents = std::max(0, vibratoCents);
+        vibratoPeriodSamples = vibratoPeriod;
+        expression.setVibrato(centsToWheel(vibratoDepthCents), vibratoPeriodSamples);
+        expressionInterval = std::max(1, minimumInterval);
+    }
+
+    /*
+        @brief
+        records note, bend and program events in buffer, which another thread drains (nullptr: none).
+        Costs a 16-byte copy per MIDI 1.0 message sent, so it can stay on in release builds
+    */
+    void setTrace(TraceBuffer* buffer) { trace = buffer; }
+
+    // the trace clock at the start of the next block; otherwise it counts the samples passed to process()
+    void setTraceTime(long long time) { traceTime = time; }
+
+    /*
+        @brief
+        times every block and its stages into profiler (nullptr: none). Costs a few reads of the cycle
+        counter and a count of the events in and out per block
+    */
+    void setProfiler(BlockProfiler* blockProfiler) { profiler = blockProfiler; }
+
+    /*
+        @brief
+        retunes one block. numSamples is the block length, which lets wheel thinning span blocks;
+        with 0 its window restarts every block
+    */
+    int process(BufferType& midiMessages, int *pitchWheelValue, int *pitchCorrection, const TuningTable& alterations, const TuningBank& bank, int *activeProgram, int *activeNoteNumber, int numSamples = 0)
+    {
+        ScopedNoAllocation noAllocation;
+        BlockProfiler::ScopedBlock<BufferType> timing(profiler, midiMessages);
+
+        // mts mode compares the table with the synth's tuning every block, so edits are sent even without input
+        const bool delaying = numSamples > 0 && (preBendDelay > 0 || requestedPreBendDelay > 0 || !delayedEvents.isEmpty() || !preBends.isEmpty());
+        // a note keeps gliding or vibrating across empty blocks; one left bent by turned off expression is brought back
+        expressive = numSamples > 0 && requestedOutputMode == OutputMode::mono && !requestedIndependentChannels && expression.isEnabled();
+        const bool expressing = expression.isMoving() || (expression.isPlaying() && !expressive);
+
+        if (!bendRangeSetupPending && pendingProgram == noPendingProgram && !hasPendingChannelPrograms && requestedOutputMode == outputMode
+            && requestedIndependentChannels == independentChannels && outputMode != OutputMode::mts && !delaying && !expressing)
+        {
+            if (midiMessages.isEmpty())
+            {
+                advanceClocks(numSamples);
+                return *pitchCorrection;
+            }
+
+            if (outputMode == OutputMode::mono)
+            {
+                const auto content = classify(midiMessages);
+
+                // nothing to retune (controllers, pedals, SysEx, ...): the host's buffer goes back as it is
+                if (content == BlockContent::passThrough)
+                {
+                    advanceClocks(numSamples);
+                    return *pitchCorrection;
+                }
+
+                // blocks made only of pitch wheel messages keep their layout: patch the bytes instead of rebuilding the buffer
+                if (content == BlockContent::pitchWheelsOnly && !isThinningWheel() && !independentChannels)
+                {
+                    rewritePitchWheelsInPlace(midiMessages, pitchWheelValue, pitchCorrection);
+                    advanceClocks(numSamples);
+                    return *pitchCorrection;
+                }
+            }
+        }
+
+        // reserved by prepare() and never handed out: clearing keeps its storage
         processedBuffer.clear();
-        processMidiInput(midiMessages, pitchWheelValue, pitchCorrection, alterations, activeNoteNumber);
-        midiMessages.swapWith(processedBuffer);
+
+        if (requestedOutputMode != outputMode)
+            changeOutputMode(0, pitchWheelValue, pitchCorrection, activeNoteNumber);
+
+        if (requestedIndependentChannels != independentChannels)
+        {
+            if (outputMode == OutputMode::mono)
+                endMonoNotes(0, pitchWheelValue, pitchCorrection, activeNoteNumber);
+            independentChannels = requestedIndependentChannels;
+            directionSlot = 0;
+        }
+
+        if (expression.isPlaying() && !expressive)
+        {
+            expression.noteOff();
+            addPitchWheel(activeChannel, clipPitch(*pitchWheelValue + *pitchCorrection), 0);
+        }
+
+        if (bendRangeSetupPending)
+        {
+            addBendRangeSetup(0);
+            bendRangeSetupPending = false;
+        }
+
+        if (pendingProgram != noPendingProgram)
+        {
+            switchProgram(pendingProgram, 0, pitchWheelValue, pitchCorrection, alterations, bank, activeProgram, *activeNoteNumber);
+
+            pendingProgram = noPendingProgram;
+        }
+
+        if (hasPendingChannelPrograms)
+            switchChannelPrograms(alterations, bank);
+
+        if (outputMode == OutputMode::mts)
+            sendTuning(bank.select(alterations, *activeProgram), 0);
+        timing.endStage(BlockTiming::setup);
+
+        processMidiInput(midiMessages, pitchWheelValue, pitchCorrection, alterations, bank, activeProgram, activeNoteNumber);
+        timing.endStage(BlockTiming::input);
+
+        if (expression.isPlaying())
+            renderExpression(numSamples, *pitchWheelValue, *pitchCorrection);
+
+        flushDeferredBend();
+        flushHeldWheels();
+        timing.endStage(BlockTiming::flush);
+
+        // the output goes back into the caller's buffer, which must have room for it (see getOutputCapacity())
+        midiMessages.clear();
+        if (delaying)
+            scheduleOutput(midiMessages, numSamples);
+        else
+            copyEvents(processedBuffer, midiMessages);
+        timing.endStage(BlockTiming::output);
+        advanceClocks(numSamples);
+
         return *pitchCorrection;
     }
 
-    int getPitchCorrection(int noteNumber, const juce::Array<int> &alterations)
+    int getPitchCorrection(int noteNumber, const TuningTable& alterations)
     {
-        if (alterations[noteNumber]==std::numeric_limits<int>::max())
+        if (alterations.isExcluded(noteNumber))
             return 0;
-        return juce::roundToInt(alterations[noteNumber]*8192/9);
+        return bendCorrections[getAlteration(noteNumber, alterations)];
     }
 
     bool isValidPitchValue(int pitchWheelValue)
     {
-        if (pitchWheelValue < 0 || pitchWheelValue >= 16384) {
-            DBG("INVALID PITCH" << pitchWheelValue);
-            return false;
-        }
-        return true;
+        return pitchWheelValue >= 0 && pitchWheelValue < 16384;
     }
 
     int clipPitch(int pitchValue)
     {
-        return juce::jmin(16383, juce::jmax(0, pitchValue));
+        return std::min(16383, std::max(0, pitchValue));
     }
 
-    void suppressNote(int channel, int suppressingNoteNumber, int samplePos, int *pitchCorrection, int *pitchWheelValue, const juce::Array<int>& alterations)
+    void suppressNote(int channel, int samplePos, int *pitchCorrection, int *pitchWheelValue)
     {
-        *pitchCorrection = getPitchCorrection(suppressingNoteNumber, alterations);
-
-        // if the suppressing note was altered
-        if (*pitchCorrection != 0) {
-            // restore pitchWheel value removing the note alteration contribution
-            MidiMessage pitchMessage = MidiMessage::pitchWheel(channel, *pitchWheelValue);
-            processedBuffer.addEvent(pitchMessage, samplePos);
-            DBG("NOTE OFF: Pitch wheel " << *pitchWheelValue << " +  correction " << *pitchCorrection);
+        // if the suppressing note was altered (the correction actually applied: the table may have changed since) or bent by expression
+        if (*pitchCorrection != 0 || expression.isPlaying()) {
+            // restore pitchWheel value removing the note alteration contribution, unless the next note's bend replaces it
+            deferPitchWheel(channel, *pitchWheelValue, samplePos);
         }
 
         // reset pitch correction for future notes
         *pitchCorrection = 0;
+        expression.noteOff();
+    }
+
+    /*
+        @brief
+        selects another table at samplePos: O(1), and the sounding note is bent to its new pitch right away
+    */
+    void switchProgram(int program, int samplePos, int *pitchWheelValue, int *pitchCorrection, const TuningTable& alterations, const TuningBank& bank, int *activeProgram, int activeNoteNumber)
+    {
+        const int previousProgram = *activeProgram;
+        *activeProgram = bank.contains(program) ? program : -1;
+        tracedProgram = *activeProgram;
+        addTrace(TraceRecord::programSwitch, activeChannel, std::max(0, activeNoteNumber), previousProgram, 0, samplePos);
+
+        if (outputMode == OutputMode::mts)
+        {
+            sendTuning(bank.select(alterations, *activeProgram), samplePos);
+            return;
+        }
+
+        if (outputMode == OutputMode::midi2)
+        {
+            const TuningTable& table = bank.select(alterations, *activeProgram);
+            forEachHeldNote([&](int channel, int noteNumber) {
+                addPacket(Ump::perNotePitch(channel, noteNumber, getNotePitch(noteNumber, getAlteration(noteNumber, table))), samplePos);
+            });
+            return;
+        }
+
+        if (outputMode != OutputMode::mono)
+        {
+            const TuningTable& table = bank.select(alterations, *activeProgram);
+            voices.forEachActive([&](int, VoiceAllocator::Voice& voice) {
+                bendVoice(voice, getVoiceBend(voice.note, table, *pitchWheelValue), samplePos);
+            });
+            return;
+        }
+
+        if (activeNoteNumber == -1)
+            return;
+
+        const int correction = getPitchCorrection(activeNoteNumber, bank.select(alterations, *activeProgram));
+
+        if (correction != *pitchCorrection)
+        {
+            *pitchCorrection = correction;
+            addPitchWheel(activeChannel, clipPitch(*pitchWheelValue + *pitchCorrection + getExpressionOffset(samplePos)), samplePos);
+        }
     }
 
-    void processMidiInput(const MidiBuffer& midiMessages, int *pitchWheelValue, int *pitchCorrection, const juce::Array<int> &alterations, int *activeNoteNumber)
+    void processMidiInput(const BufferType& midiMessages, int *pitchWheelValue, int *pitchCorrection, const TuningTable& editableTable, const TuningBank& bank, int *activeProgram, int *activeNoteNumber)
     {
-        MidiBuffer::Iterator it(midiMessages);
-        MidiMessage currentMessage;
-        int samplePos;
+        const TuningTable* alterations = &bank.select(editableTable, *activeProgram);
+        int* const sharedProgram = activeProgram;
+        tracedProgram = *activeProgram;
+        const bool perChannel = independentChannels && outputMode == OutputMode::mono;
 
-        while (it.getNextEvent(currentMessage, samplePos))
+        // one pass over the whole buffer, whichever channels it mixes
+        for (const auto metadata : midiMessages)
         {
-            
-            // DBG("MSG # " << samplePos);
+            const std::uint8_t* data = metadata.data;
+            const int samplePos = metadata.samplePosition;
+            const int status = data[0] & 0xf0;
+            const int currentChannel = (data[0] & 0x0f) + 1;
+
+            // independent channels: the event works on the state of its own channel
+            if (perChannel && status < 0xf0)
+            {
+                const auto c = (std::size_t) (currentChannel - 1);
+                pitchWheelValue = &channels.pitchWheel[c];
+                pitchCorrection = &channels.correction[c];
+                activeNoteNumber = &channels.note[c];
+                activeProgram = &channels.program[c];
+                alterations = &bank.select(editableTable, *activeProgram);
+                tracedProgram = *activeProgram;
+                activeChannel = currentChannel;
+                directionSlot = c;
+            }
 
             // safety check
             if (!isValidPitchValue(*pitchWheelValue))
             {
-                DBG("INVALID PITCH VALUE");
+                addTrace(TraceRecord::invalidPitch, currentChannel, 0, *pitchWheelValue, 0, samplePos);
                 break;
             }
 
-            int currentChannel = currentMessage.getChannel();
+            // the direction is known before the note is retuned (keyswitches aren't part of the melody)
+            if (status == 0x90 && metadata.numBytes >= 3 && data[2] != 0 && !isKeyswitch(data[1], bank))
+                trackDirection(data[1]);
+
+            // glide and vibrato up to this event
+            if (expression.isPlaying())
+                renderExpression(samplePos, *pitchWheelValue, *pitchCorrection);
+
+            // makam switch by Program Change
+            if (status == 0xc0 && metadata.numBytes >= 2 && programChangeSwitching && bank.contains(data[1]))
+            {
+                switchProgram(data[1], samplePos, pitchWheelValue, pitchCorrection, editableTable, bank, activeProgram, *activeNoteNumber);
+                alterations = &bank.select(editableTable, *activeProgram);
+                // the GUI shows the makam switched last
+                *sharedProgram = *activeProgram;
+            }
+
+            // makam switch by keyswitch (its NoteOff is dropped below)
+            else if (status == 0x90 && metadata.numBytes >= 3 && data[2] != 0 && isKeyswitch(data[1], bank))
+            {
+                switchProgram(data[1] - keyswitchBase, samplePos, pitchWheelValue, pitchCorrection, editableTable, bank, activeProgram, *activeNoteNumber);
+                alterations = &bank.select(editableTable, *activeProgram);
+                *sharedProgram = *activeProgram;
+            }
+
+            // the synth is tuned already
+            else if (outputMode == OutputMode::mts)
+            {
+                if (!(status == 0x90 && metadata.numBytes >= 3 && data[2] != 0 && exclusive && alterations->isExcluded(data[1])))
+                    addMessage(data, metadata.numBytes, samplePos);
+                else
+                    addTrace(TraceRecord::skippedNote, currentChannel, data[1], -1, data[2], samplePos);
+            }
+
+            // per-note pitch
+            else if (outputMode == OutputMode::midi2)
+            {
+                processMidi2Event(data, metadata.numBytes, samplePos, *alterations, pitchWheelValue);
+            }
+
+            // one channel per note
+            else if (outputMode != OutputMode::mono)
+            {
+                processPolyphonicEvent(data, metadata.numBytes, samplePos, *alterations, pitchWheelValue);
+            }
 
             // PitchWheel message
-            if (currentMessage.isPitchWheel())
+            else if (status == 0xe0 && metadata.numBytes >= 3)
             {
                 // store user's pitch alteration
-                *pitchWheelValue = currentMessage.getPitchWheelValue();
-                currentMessage = MidiMessage::pitchWheel(currentChannel, clipPitch(*pitchWheelValue + *pitchCorrection));
-                
+                *pitchWheelValue = data[1] | (data[2] << 7);
+
                 // forward modified pitchwheel message
-                processedBuffer.addEvent(currentMessage, samplePos);
+                addWheelBend(currentChannel, clipPitch(*pitchWheelValue + *pitchCorrection + getExpressionOffset(samplePos)), samplePos);
             }
 
             // Keypress Message
-            else if (currentMessage.isNoteOn())
+            else if (status == 0x90 && metadata.numBytes >= 3 && data[2] != 0)
             {
+                // where the sounding note is, for the glide to start from
+                const bool legato = *activeNoteNumber != -1;
+                const int previousPitch = legato && expressive ? getExpressionPitch(*activeNoteNumber, *pitchCorrection, samplePos) : 0;
+
                 // stops all playing notes (MONOPHONIC FUNCTION)
                 if (*activeNoteNumber != -1)
                 {
                     // reset pitch value for the suppressing note
-                    suppressNote(currentChannel, *activeNoteNumber, samplePos, pitchCorrection, pitchWheelValue, alterations);
+                    suppressNote(currentChannel, samplePos, pitchCorrection, pitchWheelValue);
                     // generate NoteOff message to suppress note
-                    MidiMessage cleanMessage = MidiMessage::noteOff(currentChannel, *activeNoteNumber, 0.0f);
-                    processedBuffer.addEvent(cleanMessage, samplePos);
+                    const std::uint8_t cleanMessage[] = { (std::uint8_t) (0x80 | (data[0] & 0x0f)), (std::uint8_t) *activeNoteNumber, 0 };
+                    addMessage(cleanMessage, 3, samplePos);
                 }
 
                 // get alteration for the current note
-                int noteNumber = currentMessage.getNoteNumber();
+                int noteNumber = data[1];
 
                 // do nothing if playing an excluded note in exclusive mode (+inf means excluded note)
-                if (alterations[noteNumber] != std::numeric_limits<int>::max() || !*exclusive)
+                if (!alterations->isExcluded(noteNumber) || !exclusive)
                 {
-                    *pitchCorrection = getPitchCorrection(noteNumber, alterations);
+                    *pitchCorrection = getPitchCorrection(noteNumber, *alterations);
 
-                    if (*pitchCorrection != 0) {
+                    if (expressive)
+                    {
+                        const int glideFrom = legato ? previousPitch - getExpressionPitch(noteNumber, *pitchCorrection, samplePos) : 0;
+                        expression.noteOn(samplePos, std::clamp(glideFrom, -16383, 16383), legato);
+                        nextExpressionPos = samplePos + expressionInterval;
+                    }
 
-                        // create a pitch message summing the wheel alteration and the note alteration
-                        MidiMessage pitchMessage = MidiMessage::pitchWheel(currentChannel, clipPitch(*pitchWheelValue + *pitchCorrection));
-                        DBG("NOTE ON: Pitch wheel " << *pitchWheelValue << " +  correction " << *pitchCorrection);
+                    // send a pitch message summing the wheel alteration, the note alteration and the start of the glide
+                    if (*pitchCorrection != 0 || expression.isPlaying())
+                        addPitchWheel(currentChannel, clipPitch(*pitchWheelValue + *pitchCorrection + getExpressionOffset(samplePos)), samplePos);
 
-                        processedBuffer.addEvent(pitchMessage, samplePos);
-                    }
-                    *activeNoteNumber = currentMessage.getNoteNumber();
+                    *activeNoteNumber = noteNumber;
+                    activeChannel = currentChannel;
                     // forward noteOn
-                    processedBuffer.addEvent(currentMessage, samplePos);
+                    addMessage(data, metadata.numBytes, samplePos);
                 }
                 else
                 {
-                    if(*exclusive)
-                    {
-                        DBG("Skipped note: " << noteNumber << " exclusive mode ON");
-                    }
-                    else
-                    {
-                        DBG("Skipped note: " << noteNumber << " exclusive mode OFF");
-                        DBG("With Alteration: " << alterations[noteNumber]);
-                    }
+                    addTrace(TraceRecord::skippedNote, currentChannel, noteNumber, -1, data[2], samplePos);
                 }
             }
 
             //  key release (note not suppressed by the monophonic function)
-            else if (currentMessage.isNoteOff() && currentMessage.getNoteNumber() == *activeNoteNumber)
+            else if ((status == 0x80 || status == 0x90) && metadata.numBytes >= 3 && data[1] == *activeNoteNumber)
             {
                 // suppress corresponding note
-                suppressNote(currentChannel, currentMessage.getNoteNumber(), samplePos, pitchCorrection, pitchWheelValue, alterations);
+                suppressNote(currentChannel, samplePos, pitchCorrection, pitchWheelValue);
                 // no notes are now active
                 *activeNoteNumber = -1;
 
                 // forward noteOff
-                processedBuffer.addEvent(currentMessage, samplePos);
+                addMessage(data, metadata.numBytes, samplePos);
+            }
+
+            // release of a note that was suppressed or never sounded: a second NoteOff is harmless (keyswitches stay silent)
+            else if ((status == 0x80 || status == 0x90) && metadata.numBytes >= 3)
+            {
+                if (!isKeyswitch(data[1], bank))
+                    addMessage(data, metadata.numBytes, samplePos);
+            }
+
+            // anything else (controllers, aftertouch, other program changes, SysEx, ...) goes through untouched
+            else
+            {
+                addMessage(data, metadata.numBytes, samplePos);
+            }
+        }
+    }
+
+    BufferType processedBuffer;
+
+private:
+    static constexpr int minReservedEvents = 2048;
+    static constexpr int maxOutputEventsPerInput = VoiceAllocator::maxVoices;
+    // both buffers store a 32-bit timestamp and a 16-bit size in front of each (short) message
+    static constexpr std::size_t bytesPerEvent = MidiEventBuffer::headerSize + 3;
+
+    std::size_t reservedBytes = 0;
+
+    int bendRangeIndex = PitchBend::defaultRangeIndex;
+    const int* bendCorrections = PitchBend::getCorrections(PitchBend::defaultRangeIndex);
+    bool bendRangeSetupPending = false;
+
+    static constexpr int noPendingProgram = -2;
+    int pendingProgram = noPendingProgram;
+    bool programChangeSwitching = true;
+    int keyswitchBase = -1;
+    bool exclusive = false;
+
+    // channel of the sounding note, for bends that aren't triggered by a message on that channel
+    int activeChannel = 1;
+
+    /*
+        @brief
+        state of each input channel, as parallel arrays: an event touches a field or two of one channel.
+        Wheel, correction, note and program are only used by independent channels; the melody direction
+        and the highest (ascending) or lowest (descending) note since it last turned, -1 before the first,
+        of a shared stream are in slot 0
+    */
+    struct ChannelStates
+    {
+        std::array<int, 16> pitchWheel = makeFilled(PitchBend::centre);
+        std::array<int, 16> correction {};
+        std::array<int, 16> note = makeFilled(-1);
+        std::array<int, 16> program = makeFilled(-1);
+        std::array<TuningTable::Direction, 16> direction {};
+        std::array<int, 16> directionPivot = makeFilled(-1);
+    };
+    ChannelStates channels;
+    bool independentChannels = false;
+    bool requestedIndependentChannels = false;
+    std::size_t directionSlot = 0;
+    int directionHysteresis = 0;
+
+    std::array<int, 16> pendingChannelPrograms = makeFilled(noPendingProgram);
+    bool hasPendingChannelPrograms = false;
+
+    // pre-bend lookahead: the messages of each block wait in delayedEvents, the note bends in preBends.
+    // Times count samples since the first delayed block
+    int preBendDelay = 0;
+    int requestedPreBendDelay = 0;
+    DelayQueue delayedEvents, preBends;
+    long long blockStart = 0;
+    long long lastPreBendTime = 0;
+    std::array<long long, 16> lastDelayedBendTime {};
+
+    // last pitch wheel value sent on each channel, -1 if unknown, to drop bends that change nothing
+    std::array<int, 16> sentBend = makeFilled(-1);
+
+    // restore bend of a released note, sent only if no other bend replaces it at the same position
+    struct DeferredBend
+    {
+        int channel = 0;    // 0: none
+        int value = 0;
+        int samplePos = 0;
+    };
+    DeferredBend deferredBend;
+
+    // wheel thinning: minimum interval in samples and step in wheel units, the time of the last wheel
+    // message of each channel (relative to the block) and the value held back since, -1 if none
+    int wheelInterval = 0;
+    int wheelStep = 1;
+    static constexpr int longAgo = -(1 << 30);
+    std::array<int, 16> lastWheelTime = makeFilled(longAgo);
+    std::array<int, 16> heldWheel = makeFilled(-1);
+    std::array<int, 16> heldWheelPos {};
+
+    static constexpr std::array<int, 16> makeFilled(int value)
+    {
+        std::array<int, 16> values {};
+        for (auto& v : values)
+            v = value;
+        return values;
+    }
+
+    // mono mode glide and vibrato; expressive: enabled and usable in the current block. Ramp positions
+    // are relative to the block, like the wheel times
+    BendExpression expression;
+    bool expressive = false;
+    int vibratoDepthCents = 0;
+    int vibratoPeriodSamples = 0;
+    int expressionInterval = 1;
+    int nextExpressionPos = 0;
+
+    // where trace records go, the clock at the start of the block and the program of the records
+    TraceBuffer* trace = nullptr;
+    long long traceTime = 0;
+    int tracedProgram = -1;
+
+    BlockProfiler* profiler = nullptr;
+
+    // the MPE master channel, which carries the wheel shared by every note
+    static constexpr int mpeMasterChannel = 1;
+
+    OutputMode outputMode = OutputMode::mono;
+    OutputMode requestedOutputMode = OutputMode::mono;
+    VoiceAllocator voices;
+
+    /*
+        @brief
+        multiChannel mode: the input channel (0 to 15) whose note each output channel played last, -1 before
+        the first, and the controller values and program of each input channel and of each output channel,
+        unknown until one is sent. Only the controllers a voice keeps sounding with are tracked: the others,
+        data entry and RPN/NRPN among them, only mean something in sequence
+    */
+    struct VoiceChannelStates
+    {
+        // bank select, modulation, breath, volume, pan, expression, sustain, portamento, sostenuto, soft, brightness
+        static constexpr std::array<int, 12> controllers { 0, 1, 2, 7, 10, 11, 32, 64, 65, 66, 67, 74 };
+        static constexpr int numControllers = (int) controllers.size();
+        static constexpr std::uint8_t unknown = 0xff;
+
+        // a synced note: the controllers, the program, a stolen note's release, the bend and the note
+        static_assert(numControllers + 4 <= maxOutputEventsPerInput);
+
+        static int indexOf(int controller) noexcept
+        {
+            for (int i = 0; i < numControllers; ++i)
+                if (controllers[(std::size_t) i] == controller)
+                    return i;
+            return -1;
+        }
+
+        std::array<int, 16> owner;
+        std::array<std::array<std::uint8_t, numControllers>, 16> inputControllers, sentControllers;
+        std::array<std::uint8_t, 16> inputProgram, sentProgram;
+
+        VoiceChannelStates() noexcept { reset(); }
+
+        void reset() noexcept
+        {
+            owner.fill(-1);
+            for (auto* controllers : { &inputControllers, &sentControllers })
+                for (auto& values : *controllers)
+                    values.fill(unknown);
+            inputProgram.fill(unknown);
+            sentProgram.fill(unknown);
+        }
+    };
+    VoiceChannelStates voiceChannels;
+
+    // notes sounding in midi2 mode: one bit per note of each input channel
+    std::array<std::array<std::uint64_t, 2>, 16> heldNotes {};
+
+    // MTS frequency data last sent for each key, unknownTuning before the first message
+    static constexpr std::uint32_t unknownTuning = 0xffffffff;
+    std::array<std::uint32_t, TuningTable::numNotes> sentTuning {};
+    // no alterations at all: what the synth is left with outside mts mode
+    const TuningTable equalTemperament;
+
+    // alteration of noteNumber in the current direction: the table holds both, so this is one lookup
+    int getAlteration(int noteNumber, const TuningTable& alterations) const { return alterations.get(noteNumber, channels.direction[directionSlot]); }
+
+    void trackDirection(int noteNumber)
+    {
+        auto& direction = channels.direction[directionSlot];
+        auto& directionPivot = channels.directionPivot[directionSlot];
+
+        if (directionPivot < 0)
+            directionPivot = noteNumber;
+
+        const bool ascending = direction == TuningTable::ascending;
+        const bool continues = ascending ? noteNumber > directionPivot : noteNumber < directionPivot;
+        const bool turns = ascending ? noteNumber < directionPivot - directionHysteresis : noteNumber > directionPivot + directionHysteresis;
+
+        if (turns)
+            direction = ascending ? TuningTable::descending : TuningTable::ascending;
+
+        if (continues || turns)
+            directionPivot = noteNumber;
+    }
+
+    bool isKeyswitch(int noteNumber, const TuningBank& bank) const
+    {
+        return keyswitchBase >= 0 && noteNumber >= keyswitchBase && noteNumber - keyswitchBase < bank.numPrograms;
+    }
+
+    // ends the note of the shared stream and those of independent channels
+    void endMonoNotes(int samplePos, int *pitchWheelValue, int *pitchCorrection, int *activeNoteNumber)
+    {
+        if (*activeNoteNumber != -1)
+        {
+            suppressNote(activeChannel, samplePos, pitchCorrection, pitchWheelValue);
+            addNoteOff(activeChannel, *activeNoteNumber, samplePos);
+            *activeNoteNumber = -1;
+        }
+
+        for (std::size_t c = 0; c < 16; ++c)
+        {
+            if (channels.note[c] == -1)
+                continue;
+
+            const int channel = (int) c + 1;
+            suppressNote(channel, samplePos, &channels.correction[c], &channels.pitchWheel[c]);
+            addNoteOff(channel, channels.note[c], samplePos);
+            channels.note[c] = -1;
+        }
+    }
+
+    // programs requested for single channels (or for all of them by the GUI), applied at the start of the block
+    void switchChannelPrograms(const TuningTable& editableTable, const TuningBank& bank)
+    {
+        for (std::size_t c = 0; c < 16; ++c)
+        {
+            const int program = pendingChannelPrograms[c];
+            if (program == noPendingProgram)
+                continue;
+
+            if (independentChannels && outputMode == OutputMode::mono)
+            {
+                activeChannel = (int) c + 1;
+                switchProgram(program, 0, &channels.pitchWheel[c], &channels.correction[c], editableTable, bank, &channels.program[c], channels.note[c]);
+            }
+            else
+            {
+                // remembered for when the channels become independent
+                channels.program[c] = bank.contains(program) ? program : -1;
+            }
+        }
+
+        pendingChannelPrograms.fill(noPendingProgram);
+        hasPendingChannelPrograms = false;
+    }
+
+    // ends what the current mode is playing, then configures the synth and the voices for the requested one
+    void changeOutputMode(int samplePos, int *pitchWheelValue, int *pitchCorrection, int *activeNoteNumber)
+    {
+        if (outputMode == OutputMode::mono)
+        {
+            endMonoNotes(samplePos, pitchWheelValue, pitchCorrection, activeNoteNumber);
+        }
+        else if (outputMode == OutputMode::mts)
+        {
+            // notes were forwarded as they came and end by themselves; the other modes need the synth untuned
+            sendTuning(equalTemperament, samplePos);
+        }
+        else if (outputMode == OutputMode::midi2)
+        {
+            forEachHeldNote([&](int channel, int noteNumber) {
+                addPacket(Ump::noteOff(channel, noteNumber, 0), samplePos);
+            });
+            heldNotes = {};
+        }
+        else
+        {
+            voices.forEachActive([&](int v, VoiceAllocator::Voice& voice) {
+                addNoteOff(voice.channel, voice.note, samplePos);
+                voices.release(v);
+            });
+
+            // channels that mono mode may play on again must not keep a note's bend
+            for (int v = 0; v < voices.getNumVoices(); ++v)
+                if (voices[v].bend != -1 && voices[v].bend != *pitchWheelValue)
+                    addPitchWheel(voices[v].channel, *pitchWheelValue, samplePos);
+
+            if (outputMode == OutputMode::mpe)
+                addMpeConfiguration(0, samplePos);
+        }
+
+        outputMode = requestedOutputMode;
+
+        if (outputMode == OutputMode::mpe)
+        {
+            voices.reset(VoiceAllocator::Policy::leastRecentlyReleased, mpeMasterChannel + 1, 15);
+            addMpeConfiguration(15, samplePos);
+            // the MPE Configuration Message resets the member channels to 48 semitones
+            bendRangeSetupPending = true;
+        }
+        else if (outputMode == OutputMode::multiChannel)
+        {
+            voices.reset(VoiceAllocator::Policy::roundRobin, 1, VoiceAllocator::maxVoices);
+            voiceChannels.reset();
+        }
+        else if (outputMode == OutputMode::mts)
+        {
+            // the whole table goes out with the first block
+            sentTuning.fill(unknownTuning);
+        }
+        else if (outputMode == OutputMode::midi2)
+        {
+            // the wheel still uses the channel's bend range
+            bendRangeSetupPending = true;
+        }
+    }
+
+    /*
+        @brief
+        brings the synth's tuning to table with Single Note Tuning Change messages. Only the keys whose
+        tuning differs from what was last sent go out, so switching between makams that share most notes
+        costs a few bytes, and an unchanged table costs nothing
+    */
+    void sendTuning(const TuningTable& table, int samplePos)
+    {
+        std::uint8_t message[Mts::maxMessageSize];
+        int numChanges = 0;
+
+        for (int key = 0; key < TuningTable::numNotes; ++key)
+        {
+            // keys are tuned ahead of the notes, which direction can't wait for
+            const auto data = Mts::frequencyData(getNotePitch(key, table[key]));
+            if (data == sentTuning[(std::size_t) key])
+                continue;
+
+            Mts::writeChange(message + Mts::headerSize + numChanges * Mts::bytesPerChange, key, data);
+            sentTuning[(std::size_t) key] = data;
+
+            if (++numChanges == Mts::maxChangesPerMessage)
+            {
+                addTuningMessage(message, numChanges, samplePos);
+                numChanges = 0;
+            }
+        }
+
+        if (numChanges > 0)
+            addTuningMessage(message, numChanges, samplePos);
+    }
+
+    void addTuningMessage(std::uint8_t* message, int numChanges, int samplePos)
+    {
+        const int size = Mts::headerSize + numChanges * Mts::bytesPerChange + 1;
+        Mts::writeHeader(message, 0, numChanges);
+        message[size - 1] = 0xf7;
+        addMessage(message, size, samplePos);
+    }
+
+    /*
+        @brief
+        midi2 mode: each note carries its own absolute pitch, so an altered note costs no extra message
+        and chords need no channel juggling. The wheel is forwarded as a 32-bit channel pitch bend,
+        which the synth adds to every note's pitch
+    */
+    void processMidi2Event(const std::uint8_t* data, int numBytes, int samplePos, const TuningTable& alterations, int *pitchWheelValue)
+    {
+        const int status = data[0] & 0xf0;
+
+        // other channel voice messages travel as MIDI 1.0 packets; system messages have no place in this stream
+        if (numBytes < 3 || (status != 0x80 && status != 0x90 && status != 0xe0))
+        {
+            if (status != 0xf0 && numBytes <= 3)
+                addPacket(Ump::midi1ChannelVoice(data, numBytes), samplePos);
+            return;
+        }
+
+        const int channel = data[0] & 0x0f;
+        const int noteNumber = data[1] & 0x7f;
+        auto& held = heldNotes[(std::size_t) channel][(std::size_t) (noteNumber >> 6)];
+        const std::uint64_t bit = 1ull << (noteNumber & 63);
+
+        if (status == 0xe0)
+        {
+            *pitchWheelValue = data[1] | (data[2] << 7);
+            addPacket(Ump::pitchBend(channel, *pitchWheelValue), samplePos);
+        }
+        else if (status == 0x90 && data[2] != 0)
+        {
+            if (alterations.isExcluded(noteNumber) && exclusive)
+            {
+                addTrace(TraceRecord::skippedNote, channel + 1, noteNumber, -1, data[2], samplePos);
+                return;
+            }
+
+            addPacket(Ump::noteOn(channel, noteNumber, data[2], getNotePitch(noteNumber, getAlteration(noteNumber, alterations))), samplePos);
+            held |= bit;
+        }
+        else if ((status == 0x80 || status == 0x90) && (held & bit) != 0)
+        {
+            addPacket(Ump::noteOff(channel, noteNumber, status == 0x80 ? data[2] : 0), samplePos);
+            held &= ~bit;
+        }
+    }
+
+    std::uint32_t getNotePitch(int noteNumber, int alteration) const
+    {
+        return Ump::pitch(noteNumber, alteration == TuningTable::excluded ? 0 : alteration);
+    }
+
+    // calls function(channel, noteNumber) for the notes sounding in midi2 mode
+    template <typename Function>
+    void forEachHeldNote(Function&& function)
+    {
+        for (int channel = 0; channel < 16; ++channel)
+            for (int word = 0; word < 2; ++word)
+                for (auto bits = heldNotes[(std::size_t) channel][(std::size_t) word]; bits != 0; bits &= bits - 1)
+                    function(channel, word * 64 + countTrailingZeros(bits));
+    }
+
+    static int countTrailingZeros(std::uint64_t bits) noexcept
+    {
+        int n = 0;
+        for (; (bits & 1) == 0; bits >>= 1)
+            ++n;
+        return n;
+    }
+
+    void addPacket(const Ump::Packet& packet, int samplePos)
+    {
+        std::uint8_t bytes[Ump::numBytes];
+        std::memcpy(bytes, packet.data(), sizeof(bytes));
+        processedBuffer.addEvent(bytes, Ump::numBytes, samplePos);
+    }
+
+    void addPacket(std::uint32_t word, int samplePos)
+    {
+        std::uint8_t bytes[sizeof(word)];
+        std::memcpy(bytes, &word, sizeof(bytes));
+        processedBuffer.addEvent(bytes, (int) sizeof(bytes), samplePos);
+    }
+
+    // note events and the wheel of the mpe and multiChannel modes; anything else goes to forwardToVoices()
+    void processPolyphonicEvent(const std::uint8_t* data, int numBytes, int samplePos, const TuningTable& alterations, int *pitchWheelValue)
+    {
+        const int status = data[0] & 0xf0;
+
+        if (numBytes < 3 || (status != 0x80 && status != 0x90 && status != 0xe0))
+        {
+            forwardToVoices(data, numBytes, samplePos);
+            return;
+        }
+
+        const int inputChannel = data[0] & 0x0f;
+        const int noteNumber = data[1];
+
+        if (status == 0xe0)
+        {
+            *pitchWheelValue = data[1] | (data[2] << 7);
+
+            // MPE synths add the master channel's wheel to every note, otherwise each voice carries it
+            if (outputMode == OutputMode::mpe)
+                addWheelBend(mpeMasterChannel, *pitchWheelValue, samplePos);
+            else
+                voices.forEachActive([&](int, VoiceAllocator::Voice& voice) {
+                    bendVoice(voice, getVoiceBend(voice.note, alterations, *pitchWheelValue), samplePos);
+                });
+        }
+        else if (status == 0x90 && data[2] != 0)
+        {
+            if (alterations.isExcluded(noteNumber) && exclusive)
+            {
+                addTrace(TraceRecord::skippedNote, inputChannel + 1, noteNumber, -1, data[2], samplePos);
+                return;
+            }
+
+            // a key struck again before its release restarts on a fresh voice
+            endVoice(voices.find(inputChannel, noteNumber), 0, samplePos);
+
+            VoiceAllocator::Voice stolen;
+            auto& voice = voices[voices.noteOn(inputChannel, noteNumber, stolen)];
+
+            if (stolen.isActive())
+                addNoteOff(voice.channel, stolen.note, samplePos);
+
+            if (outputMode == OutputMode::multiChannel)
+                syncVoiceChannel(voice.channel, inputChannel, samplePos);
+
+            bendVoice(voice, getVoiceBend(noteNumber, alterations, *pitchWheelValue), samplePos);
+
+            const std::uint8_t noteOn[] = { (std::uint8_t) (0x90 | (voice.channel - 1)), data[1], data[2] };
+            addMessage(noteOn, 3, samplePos);
+        }
+        else if (status == 0x80 || status == 0x90)
+        {
+            // notes that never got a voice (excluded, or stolen since) are already silent
+            endVoice(voices.find(inputChannel, noteNumber), data[2], samplePos);
+        }
+    }
+
+    /*
+        @brief
+        the other messages of the mpe and multiChannel modes. Channel-wide ones (controllers such as the
+        sustain pedal, channel pressure, program changes) go to the MPE master channel, or in multiChannel
+        mode to the channels whose last note came from their input channel, sounding or still ringing
+        (see syncVoiceChannel for the others); polyphonic pressure follows its note's voice; system messages pass
+    */
+    void forwardToVoices(const std::uint8_t* data, int numBytes, int samplePos)
+    {
+        const int status = data[0] & 0xf0;
+
+        if (status == 0xf0 || numBytes > 3)
+        {
+            addMessage(data, numBytes, samplePos);
+            return;
+        }
+
+        if (status == 0xa0)
+        {
+            const int v = numBytes == 3 ? voices.find(data[0] & 0x0f, data[1]) : VoiceAllocator::none;
+            if (v == VoiceAllocator::none)
+                return;
+
+            // an MPE note's pressure is its member channel's pressure
+            const int channel = voices[v].channel - 1;
+            const std::uint8_t polyPressure[] = { (std::uint8_t) (0xa0 | channel), data[1], data[2] };
+            const std::uint8_t channelPressure[] = { (std::uint8_t) (0xd0 | channel), data[2] };
+
+            if (outputMode == OutputMode::mpe)
+                addMessage(channelPressure, 2, samplePos);
+            else
+                addMessage(polyPressure, 3, samplePos);
+            return;
+        }
+
+        std::uint8_t message[3] = {};
+        std::memcpy(message, data, (std::size_t) numBytes);
+
+        if (outputMode == OutputMode::mpe)
+        {
+            message[0] = (std::uint8_t) (status | (mpeMasterChannel - 1));
+            addMessage(message, numBytes, samplePos);
+            return;
+        }
+
+        const int inputChannel = data[0] & 0x0f;
+        const int controller = status == 0xb0 && numBytes == 3 ? VoiceChannelStates::indexOf(data[1]) : -1;
+        const bool isProgram = status == 0xc0 && numBytes == 2;
+
+        if (controller >= 0)
+            voiceChannels.inputControllers[(std::size_t) inputChannel][(std::size_t) controller] = data[2];
+        else if (isProgram)
+            voiceChannels.inputProgram[(std::size_t) inputChannel] = data[1];
+
+        for (int channel = 1; channel <= 16; ++channel)
+        {
+            const auto c = (std::size_t) (channel - 1);
+            if (voiceChannels.owner[c] != inputChannel)
+                continue;
+
+            message[0] = (std::uint8_t) (status | (channel - 1));
+            addMessage(message, numBytes, samplePos);
+
+            if (controller >= 0)
+                voiceChannels.sentControllers[c][(std::size_t) controller] = data[2];
+            else if (isProgram)
+                voiceChannels.sentProgram[c] = data[1];
+        }
+    }
+
+    /*
+        @brief
+        multiChannel mode: a note of inputChannel is about to play on outputChannel, which takes the
+        controllers and program that channel sent while the output channel served other input channels (or none)
+    */
+    void syncVoiceChannel(int outputChannel, int inputChannel, int samplePos)
+    {
+        const auto out = (std::size_t) (outputChannel - 1);
+        const auto in = (std::size_t) inputChannel;
+        voiceChannels.owner[out] = inputChannel;
+
+        auto& sent = voiceChannels.sentControllers[out];
+        const auto& wanted = voiceChannels.inputControllers[in];
+
+        // bank select included, before the program change
+        for (std::size_t i = 0; i < sent.size(); ++i)
+        {
+            if (wanted[i] != VoiceChannelStates::unknown && wanted[i] != sent[i])
+            {
+                addController(outputChannel, VoiceChannelStates::controllers[i], wanted[i], samplePos);
+                sent[i] = wanted[i];
             }
         }
+
+        const auto program = voiceChannels.inputProgram[in];
+        if (program != VoiceChannelStates::unknown && program != voiceChannels.sentProgram[out])
+        {
+            const std::uint8_t programChange[] = { (std::uint8_t) (0xc0 | out), program };
+            addMessage(programChange, 2, samplePos);
+            voiceChannels.sentProgram[out] = program;
+        }
+    }
+
+    int getVoiceBend(int noteNumber, const TuningTable& alterations, int wheel)
+    {
+        const int base = outputMode == OutputMode::mpe ? PitchBend::centre : wheel;
+        return clipPitch(base + getPitchCorrection(noteNumber, alterations));
+    }
+
+    void bendVoice(VoiceAllocator::Voice& voice, int value, int samplePos)
+    {
+        if (voice.bend == value)
+            return;
+
+        addPitchWheel(voice.channel, value, samplePos);
+        voice.bend = value;
+    }
+
+    void endVoice(int v, int velocity, int samplePos)
+    {
+        if (v == VoiceAllocator::none)
+            return;
+
+        const std::uint8_t noteOff[] = { (std::uint8_t) (0x80 | (voices[v].channel - 1)), (std::uint8_t) voices[v].note, (std::uint8_t) velocity };
+        addMessage(noteOff, 3, samplePos);
+        voices.release(v);
+    }
+
+    void addNoteOff(int channel, int noteNumber, int samplePos)
+    {
+        const std::uint8_t noteOff[] = { (std::uint8_t) (0x80 | (channel - 1)), (std::uint8_t) noteNumber, 0 };
+        addMessage(noteOff, 3, samplePos);
+    }
+
+    // RPN 6 on the master channel: the lower zone gets numMemberChannels channels, 0 turns MPE off
+    void addMpeConfiguration(int numMemberChannels, int samplePos)
+    {
+        addController(mpeMasterChannel, 101, 0, samplePos);
+        addController(mpeMasterChannel, 100, 6, samplePos);
+        addController(mpeMasterChannel, 6, numMemberChannels, samplePos);
+        addController(mpeMasterChannel, 101, 127, samplePos);
+        addController(mpeMasterChannel, 100, 127, samplePos);
+    }
+
+    void addController(int channel, int controller, int value, int samplePos)
+    {
+        const std::uint8_t message[] = { (std::uint8_t) (0xb0 | (channel - 1)), (std::uint8_t) controller, (std::uint8_t) value };
+        addMessage(message, 3, samplePos);
+    }
+
+    // RPN 0 (pitch bend sensitivity) on every channel, then the null RPN so later data entry goes nowhere
+    void addBendRangeSetup(int samplePos)
+    {
+        // MIDI 2.0 addresses the RPN in a single message: semitones in the top 7 bits, cents below
+        if (outputMode == OutputMode::midi2)
+        {
+            for (int channel = 0; channel < 16; ++channel)
+                addPacket(Ump::registeredController(channel, 0, 0, (std::uint32_t) PitchBend::ranges[(std::size_t) bendRangeIndex] << 25), samplePos);
+            return;
+        }
+
+        for (int channel = 1; channel <= 16; ++channel)
+        {
+            addController(channel, 101, 0, samplePos);
+            addController(channel, 100, 0, samplePos);
+            addController(channel, 6, PitchBend::ranges[(std::size_t) bendRangeIndex], samplePos);
+            addController(channel, 38, 0, samplePos);
+            addController(channel, 101, 127, samplePos);
+            addController(channel, 100, 127, samplePos);
+        }
+    }
+
+    /*
+        @brief
+        every MIDI 1.0 message goes out through here, so that the bend state of each channel stays known:
+        a deferred restore bend goes out first unless the message is a NoteOff at the same position (the
+        next note's bend may still replace it), and a wheel value held back by thinning goes out before
+        any other message of its channel
+    */
+    void addMessage(const std::uint8_t* data, int numBytes, int samplePos)
+    {
+        const int status = data[0] & 0xf0;
+        const int channel = (data[0] & 0x0f) + 1;
+
+        if (deferredBend.channel != 0)
+        {
+            const bool isNoteOff = status == 0x80 || (status == 0x90 && numBytes >= 3 && data[2] == 0);
+            if (!(isNoteOff && channel == deferredBend.channel && samplePos == deferredBend.samplePos))
+                flushDeferredBend();
+        }
+
+        if (status < 0xf0)
+        {
+            if (status != 0xe0 && heldWheel[(std::size_t) (channel - 1)] >= 0)
+                flushHeldWheel(channel, samplePos);
+
+            auto& bend = sentBend[(std::size_t) (channel - 1)];
+
+            if (status == 0xe0 && numBytes >= 3)
+            {
+                const int value = data[1] | (data[2] << 7);
+                addTrace(TraceRecord::bend, channel, 0, value, bend, samplePos);
+                bend = value;
+            }
+            else if ((status == 0x80 || status == 0x90) && numBytes >= 3)
+            {
+                addTrace(status == 0x90 && data[2] != 0 ? TraceRecord::noteOn : TraceRecord::noteOff, channel, data[1], bend, data[2], samplePos);
+            }
+        }
+
+        processedBuffer.addEvent(data, numBytes, samplePos);
+    }
+
+    void deferPitchWheel(int channel, int value, int samplePos)
+    {
+        flushDeferredBend();
+        // the restore carries the latest wheel value
+        heldWheel[(std::size_t) (channel - 1)] = -1;
+        deferredBend = { channel, value, samplePos };
+    }
+
+    void flushDeferredBend()
+    {
+        if (deferredBend.channel == 0)
+            return;
+
+        const auto bend = deferredBend;
+        deferredBend.channel = 0;
+        addPitchWheel(bend.channel, bend.value, bend.samplePos);
+    }
+
+    int centsToWheel(int cents) const
+    {
+        return cents * PitchBend::centre / (PitchBend::ranges[(std::size_t) bendRangeIndex] * 100);
+    }
+
+    // pitch of a note in wheel units (a semitone is centre / range), expression glide included
+    int getExpressionPitch(int noteNumber, int correction, int samplePos) const
+    {
+        return noteNumber * PitchBend::centre / PitchBend::ranges[(std::size_t) bendRangeIndex] + correction + expression.getGlideOffset(samplePos);
+    }
+
+    int getExpressionOffset(int samplePos) const { return expression.getOffset(samplePos); }
+
+    // the glide and vibrato ramp of the sounding note up to samplePos (excluded), one point per expressionInterval samples
+    void renderExpression(int samplePos, int pitchWheelValue, int pitchCorrection)
+    {
+        for (; nextExpressionPos < samplePos; nextExpressionPos += expressionInterval)
+            addPitchWheel(activeChannel, clipPitch(pitchWheelValue + pitchCorrection + expression.getOffset(nextExpressionPos)), nextExpressionPos);
+    }
+
+    // the next block starts numSamples later for every clock that spans blocks
+    void advanceClocks(int numSamples)
+    {
+        advanceWheelTime(numSamples);
+        advanceExpression(numSamples);
+        traceTime += std::max(0, numSamples);
+    }
+
+    void addTrace(TraceRecord::Type type, int channel, int note, int value, int extra, int samplePos) noexcept
+    {
+        if (trace == nullptr)
+            return;
+
+        const auto clip = [](int x) { return (std::int16_t) std::clamp(x, -32768, 32767); };
+        trace->push({ traceTime + samplePos, clip(value), clip(extra), type, (std::uint8_t) channel, (std::uint8_t) note, (std::int8_t) tracedProgram });
+    }
+
+    void advanceExpression(int numSamples)
+    {
+        if (numSamples <= 0)
+            return;
+
+        expression.advance(numSamples);
+        nextExpressionPos = std::max(0, nextExpressionPos - numSamples);
+    }
+
+    bool isThinningWheel() const { return wheelInterval > 0 || wheelStep > 1; }
+
+    // wheel times are relative to the block: the next one starts numSamples later (unknown if 0)
+    void advanceWheelTime(int numSamples)
+    {
+        for (auto& time : lastWheelTime)
+            time = numSamples > 0 ? std::max(time - numSamples, -wheelInterval) : -wheelInterval;
+    }
+
+    // a wheel movement: thinned if requested, the latest value held back until it is due
+    void addWheelBend(int channel, int value, int samplePos)
+    {
+        const auto c = (std::size_t) (channel - 1);
+
+        if (isThinningWheel())
+        {
+            const bool due = samplePos - lastWheelTime[c] >= wheelInterval;
+            const bool moved = sentBend[c] < 0 || std::abs(value - sentBend[c]) >= wheelStep;
+
+            if (!due || !moved)
+            {
+                heldWheel[c] = value;
+                heldWheelPos[c] = samplePos;
+                return;
+            }
+
+            lastWheelTime[c] = samplePos;
+        }
+
+        addPitchWheel(channel, value, samplePos);
+    }
+
+    void flushHeldWheel(int channel, int samplePos)
+    {
+        const auto c = (std::size_t) (channel - 1);
+        const int value = heldWheel[c];
+        heldWheel[c] = -1;
+        lastWheelTime[c] = samplePos;
+        addPitchWheel(channel, value, samplePos);
+    }
+
+    // the final values of the block, at the position they were played
+    void flushHeldWheels()
+    {
+        for (int channel = 1; channel <= 16; ++channel)
+            if (heldWheel[(std::size_t) (channel - 1)] >= 0)
+                flushHeldWheel(channel, heldWheelPos[(std::size_t) (channel - 1)]);
+    }
+
+    // appends every event of source to destination, which has room for them after prepare()
+    static void copyEvents(const BufferType& source, BufferType& destination)
+    {
+        for (const auto event : source)
+            destination.addEvent(event.data, event.numBytes, event.samplePosition);
+    }
+
+    /*
+        @brief
+        moves the block's output (processedBuffer, at input time) into the lookahead and writes what is due
+        in this block to output. A bend followed by a NoteOn on its channel at the same position is a note
+        bend: it goes out delaySamples early, but never before a bend of the same channel that is still
+        waiting, so it can't be overridden by an older value
+    */
+    void scheduleOutput(BufferType& output, int numSamples)
+    {
+        // a new delay: what is waiting goes out now, ahead of this block
+        if (requestedPreBendDelay != preBendDelay)
+        {
+            writeDueEvents(output, blockStart, 1, true);
+            preBendDelay = requestedPreBendDelay;
+        }
+
+        for (auto it = processedBuffer.begin(); it != processedBuffer.end(); ++it)
+        {
+            const auto event = *it;
+            const long long inputTime = blockStart + event.samplePosition;
+            const int status = event.data[0] & 0xf0;
+            const auto c = (std::size_t) (event.data[0] & 0x0f);
+
+            if (status == 0xe0 && isNoteBend(it))
+            {
+                const long long time = std::max({ inputTime, lastDelayedBendTime[c] + 1, lastPreBendTime });
+                if (preBends.push(time, event.data, event.numBytes))
+                {
+                    lastPreBendTime = time;
+                    continue;
+                }
+            }
+            else if (delayedEvents.push(inputTime + preBendDelay, event.data, event.numBytes))
+            {
+                if (status == 0xe0)
+                    lastDelayedBendTime[c] = inputTime + preBendDelay;
+                continue;
+            }
+
+            // the lookahead is full: better late than lost
+            output.addEvent(event.data, event.numBytes, event.samplePosition);
+        }
+
+        writeDueEvents(output, blockStart, numSamples, false);
+        blockStart += numSamples;
+    }
+
+    // merges the two queues, both in time order (note bends first on a tie), up to the end of the block or all of them
+    void writeDueEvents(BufferType& output, long long start, int numSamples, bool all)
+    {
+        const long long end = start + numSamples;
+
+        for (;;)
+        {
+            const bool bendDue = !preBends.isEmpty() && (all || preBends.frontTime() < end);
+            const bool eventDue = !delayedEvents.isEmpty() && (all || delayedEvents.frontTime() < end);
+
+            if (!bendDue && !eventDue)
+                break;
+
+            auto& queue = bendDue && (!eventDue || preBends.frontTime() <= delayedEvents.frontTime()) ? preBends : delayedEvents;
+            const auto position = (int) std::clamp(queue.frontTime() - start, 0LL, (long long) numSamples - 1);
+            const auto event = queue.front();
+            output.addEvent(event.data, event.numBytes, position);
+            queue.pop();
+        }
+    }
+
+    // a bend that retunes the NoteOn following it at the same position, on the same channel
+    template <typename Iterator>
+    bool isNoteBend(Iterator bend) const
+    {
+        const auto event = *bend;
+        const int channel = event.data[0] & 0x0f;
+
+        for (auto it = ++bend; it != processedBuffer.end(); ++it)
+        {
+            const auto next = *it;
+            if (next.samplePosition != event.samplePosition)
+                return false;
+
+            if ((next.data[0] & 0x0f) == channel && next.numBytes >= 3)
+            {
+                const int status = next.data[0] & 0xf0;
+                if (status == 0x90 && next.data[2] != 0)
+                    return true;
+                if (status == 0xe0)
+                    return false;
+            }
+        }
+
+        return false;
+    }
+
+    void addPitchWheel(int channel, int value, int samplePos)
+    {
+        const auto c = (std::size_t) (channel - 1);
+
+        // a restore bend at the same position is replaced, a held wheel value superseded
+        if (deferredBend.channel == channel && deferredBend.samplePos == samplePos)
+            deferredBend.channel = 0;
+        heldWheel[c] = -1;
+
+        if (sentBend[c] == value)
+            return;
+
+        const std::uint8_t pitchMessage[] = { (std::uint8_t) (0xe0 | (channel - 1)), (std::uint8_t) (value & 0x7f), (std::uint8_t) ((value >> 7) & 0x7f) };
+        addMessage(pitchMessage, 3, samplePos);
+    }
+
+    enum class BlockContent
+    {
+        passThrough,        // nothing the mono engine changes
+        pitchWheelsOnly,
+        other
+    };
+
+    BlockContent classify(const BufferType& midiMessages) const
+    {
+        bool onlyPitchWheels = true;
+        bool retunes = false;
+
+        for (const auto metadata : midiMessages)
+        {
+            const int status = metadata.data[0] & 0xf0;
+            const bool isPitchWheel = status == 0xe0 && metadata.numBytes >= 3;
+
+            onlyPitchWheels = onlyPitchWheels && isPitchWheel;
+            retunes = retunes || isPitchWheel || status == 0x80 || status == 0x90 || (status == 0xc0 && programChangeSwitching);
+        }
+
+        return !retunes ? BlockContent::passThrough : (onlyPitchWheels ? BlockContent::pitchWheelsOnly : BlockContent::other);
+    }
+
+    void rewritePitchWheelsInPlace(BufferType& midiMessages, int *pitchWheelValue, const int *pitchCorrection)
+    {
+        for (const auto metadata : midiMessages)
+        {
+            // the buffer is ours to modify, the iterator only hands out const views of it
+            auto* data = const_cast<std::uint8_t*>(metadata.data);
+
+            // store user's pitch alteration
+            *pitchWheelValue = data[1] | (data[2] << 7);
+            const int value = clipPitch(*pitchWheelValue + *pitchCorrection);
+            data[1] = (std::uint8_t) (value & 0x7f);
+            data[2] = (std::uint8_t) ((value >> 7) & 0x7f);
+            addTrace(TraceRecord::bend, (data[0] & 0x0f) + 1, 0, value, sentBend[(std::size_t) (data[0] & 0x0f)], metadata.samplePosition);
+            sentBend[(std::size_t) (data[0] & 0x0f)] = value;
+        }
     }
+};
 
-    MidiBuffer processedBuffer;
-    bool* exclusive;
-};
\ No newline at end of file
+using MidiProcessor = BasicMidiProcessor<MidiEventBuffer>;
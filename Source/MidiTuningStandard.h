@@ -0,0 +1,71 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    MidiTuningStandard.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstdint>
+#include "UniversalMidiPacket.h"
+
+/*
+    @brief
+    MIDI Tuning Standard real-time Single Note Tuning Change messages
+    (F0 7F <device> 08 02 <program> <count> [<key> <xx> <yy> <zz>] ... F7): the synth retunes each key
+    itself, so the notes go out untouched and cost no pitch bend. Real-time, so sounding notes follow.
+*/
+namespace Mts
+{
+    constexpr std::uint8_t allDevices = 0x7f;
+    constexpr int headerSize = 7;           // F0 7F <device> 08 02 <program> <count>
+    constexpr int bytesPerChange = 4;       // key, then the frequency data
+    constexpr int maxChangesPerMessage = 127;
+    constexpr int maxMessageSize = headerSize + maxChangesPerMessage * bytesPerChange + 1;
+
+    /*
+        @brief
+        frequency data of a Pitch 7.25 value: semitone, then the fraction of a semitone in 14 bits
+        (100 / 16384 cents), packed as xx << 14 | yyzz. 7F 7F 7F means "no change", so the top is clamped below it
+    */
+    constexpr std::uint32_t frequencyData(std::uint32_t pitch) noexcept
+    {
+        std::uint32_t semitone = pitch >> 25;
+        std::uint32_t fraction = ((pitch & (Ump::semitone - 1)) + (1u << 10)) >> 11;
+
+        if (fraction == 1u << 14)
+        {
+            ++semitone;
+            fraction = 0;
+        }
+
+        const std::uint32_t data = semitone << 14 | fraction;
+        return data < 0x1ffffe ? data : 0x1ffffe;
+    }
+
+    inline void writeHeader(std::uint8_t* message, int tuningProgram, int numChanges) noexcept
+    {
+        message[0] = 0xf0;
+        message[1] = 0x7f;
+        message[2] = allDevices;
+        message[3] = 0x08;
+        message[4] = 0x02;
+        message[5] = (std::uint8_t) (tuningProgram & 0x7f);
+        message[6] = (std::uint8_t) numChanges;
+    }
+
+    inline void writeChange(std::uint8_t* change, int key, std::uint32_t data) noexcept
+    {
+        change[0] = (std::uint8_t) (key & 0x7f);
+        change[1] = (std::uint8_t) ((data >> 14) & 0x7f);
+        change[2] = (std::uint8_t) ((data >> 7) & 0x7f);
+        change[3] = (std::uint8_t) (data & 0x7f);
+    }
+}
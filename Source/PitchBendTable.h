@@ -0,0 +1,85 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    PitchBendTable.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+namespace PitchBend
+{
+    // 14-bit pitch wheel: 8192 is the centre, the synth's bend range maps to +-8192
+    constexpr int centre = 8192;
+
+    /*
+        @brief
+        pitch wheel offset for every alteration in [-commasPerTone, commasPerTone], computed at compile time
+        for a synth whose bend range is +-rangeSemitones (a tone is two semitones)
+    */
+    template <int rangeSemitones, int commasPerTone = 9>
+    struct Table
+    {
+        static_assert(rangeSemitones > 0 && commasPerTone > 0, "invalid bend range or comma model");
+
+        static constexpr int maxCommas = commasPerTone;
+        static constexpr int size = 2 * commasPerTone + 1;
+
+        static constexpr std::array<int, size> build()
+        {
+            std::array<int, size> corrections {};
+            constexpr int denominator = commasPerTone * rangeSemitones;
+
+            for (int commas = -commasPerTone; commas <= commasPerTone; ++commas)
+            {
+                const int numerator = commas * 2 * centre;
+                // round half away from zero, then clip to what the wheel can express
+                int value = (numerator + (numerator < 0 ? -denominator : denominator) / 2) / denominator;
+                value = value < -centre ? -centre : (value > centre - 1 ? centre - 1 : value);
+                corrections[(std::size_t) (commas + commasPerTone)] = value;
+            }
+
+            return corrections;
+        }
+
+        static constexpr std::array<int, size> corrections = build();
+    };
+
+    // the ranges offered to the user, in semitones
+    constexpr std::array<int, 8> ranges { 1, 2, 3, 4, 7, 12, 24, 48 };
+    constexpr int defaultRangeIndex = 1; // +-1 tone, the range MakaMIDI always assumed
+
+    /*
+        @brief
+        returns the table for ranges[rangeIndex], offset so that it can be indexed directly with
+        an alteration in commas
+    */
+    inline const int* getCorrections(int rangeIndex) noexcept
+    {
+        static const int* const tables[] = {
+            Table<1>::corrections.data()  + Table<1>::maxCommas,
+            Table<2>::corrections.data()  + Table<2>::maxCommas,
+            Table<3>::corrections.data()  + Table<3>::maxCommas,
+            Table<4>::corrections.data()  + Table<4>::maxCommas,
+            Table<7>::corrections.data()  + Table<7>::maxCommas,
+            Table<12>::corrections.data() + Table<12>::maxCommas,
+            Table<24>::corrections.data() + Table<24>::maxCommas,
+            Table<48>::corrections.data() + Table<48>::maxCommas
+        };
+        static_assert(sizeof(tables) / sizeof(tables[0]) == ranges.size(), "one table per range");
+
+        if (rangeIndex < 0 || rangeIndex >= (int) ranges.size())
+            rangeIndex = defaultRangeIndex;
+
+        return tables[rangeIndex];
+    }
+}
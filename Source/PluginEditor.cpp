@@ -13,6 +13,7 @@
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "TuningExport.h"
 
 
 //==============================================================================
@@ -25,8 +26,6 @@ MidiEffectAudioProcessorEditor::MidiEffectAudioProcessorEditor (MidiEffectAudioP
 
     loadBtn.onClick = [this](){
 
-        audioProcessor.readingScale = true;
-
         fileChooser = std::make_unique<juce::FileChooser>("Choose a file",
             audioProcessor.root,
             "*");
@@ -37,26 +36,25 @@ MidiEffectAudioProcessorEditor::MidiEffectAudioProcessorEditor (MidiEffectAudioP
 
         fileChooser->launchAsync(fileChooserFlags, [this](const juce::FileChooser& chooser) {
             juce::File chosenFile(chooser.getResult());
-            if (chosenFile.getFileExtension().toLowerCase() == ".csv") {
+            const auto extension = chosenFile.getFileExtension().toLowerCase();
+
+            if (extension == ".csv" || extension == CompiledTuning::fileExtension) {
                 audioProcessor.savedFile = chosenFile;
                 audioProcessor.root = chosenFile.getParentDirectory().getFullPathName();
-                audioProcessor.readScale(chosenFile);
-                
-                updateBoxes(&audioProcessor);
 
-                for(int i=0; i<16; i++){
-                    updateAlteration(i, true);
-                }
-
-                juce::Timer::callAfterDelay(100, [this] {
-                    audioProcessor.readingScale = false;
-                });
+                // the whole table is published at once, the boxes only mirror it
+                const auto result = audioProcessor.readScale(chosenFile);
+                shownProgram = audioProcessor.getActiveProgram();
+                updateBoxes(&audioProcessor);
+                makamBox.setSelectedId(0, juce::NotificationType::dontSendNotification);
 
+                if (!result.diagnostics.empty())
+                    showDiagnostics(chosenFile, result);
             }
             else{
                 AlertWindow::showMessageBoxAsync(AlertWindow::WarningIcon,
                                  "Invalid file",
-                                 "Please select a CSV file.");
+                                 "Please select a CSV or compiled (.mkt) scale file.");
             }
         });
 
@@ -69,18 +67,12 @@ MidiEffectAudioProcessorEditor::MidiEffectAudioProcessorEditor (MidiEffectAudioP
     exModeBtn.setColour(juce::TextButton::textColourOffId, juce::Colours::grey);
     exModeBtn.setColour(juce::TextButton::buttonColourId, juce::Colours::black);
     exModeBtn.setColour(juce::TextButton::buttonOnColourId, juce::Colours::darkred);
-    exModeBtn.setToggleState(false, false); // default off
+    exModeBtn.setClickingTogglesState(true);
+    exModeAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ButtonAttachment>(audioProcessor.apvts, "Exclusive", exModeBtn);
 
     loadBtn.setColour(juce::TextButton::buttonColourId, juce::Colours::black);
     loadBtn.setColour(juce::TextButton::textColourOffId, juce::Colours::darkgoldenrod);
 
-    exModeBtn.onClick = [this] {
-        audioProcessor.exclusive = !audioProcessor.exclusive;
-        exModeBtn.setToggleState(audioProcessor.exclusive, false);
-        String s = audioProcessor.exclusive ? "ON" : "OFF";
-        DBG("Exclusive mode: " << s);
-    };
-
 
     addAndMakeVisible(firstControlRow);
     addAndMakeVisible(noteLabel1);
@@ -92,21 +84,82 @@ MidiEffectAudioProcessorEditor::MidiEffectAudioProcessorEditor (MidiEffectAudioP
     noteLabel2.setText("Note: ", juce::NotificationType::dontSendNotification);
     alterationLabel2.setText("Alteration (commas): ", juce::NotificationType::dontSendNotification);
 
+    // setup "Bend range" box, the items must be there before the attachment selects one
+    bendRangeBox.addItemList(audioProcessor.apvts.getParameter("Bend Range")->getAllValueStrings(), 1);
+    bendRangeBox.setTooltip("Pitch bend range of the synth, sent to it as RPN 0");
+    bendRangeAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ComboBoxAttachment>(audioProcessor.apvts, "Bend Range", bendRangeBox);
+
+    // setup "Output mode" box
+    outputModeBox.addItemList(audioProcessor.apvts.getParameter("Output Mode")->getAllValueStrings(), 1);
+    outputModeBox.setTooltip("Mono retunes one note at a time; MPE and Multi-channel give each note a channel of its own; MTS retunes the synth itself with SysEx");
+    outputModeAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ComboBoxAttachment>(audioProcessor.apvts, "Output Mode", outputModeBox);
+
+    // setup "Makam" box, filled from the library index
+    makamBox.setTextWhenNothingSelected("Makam");
+    makamBox.onChange = [this] { makamSelected(); };
+    audioProcessor.library->addChangeListener(this);
+    updateMakamList();
+
+    // setup "Link" box: instances in the same group follow each other's makam
+    linkBox.addItem("No link", 1);
+    for (int group = 1; group <= TuningPool::numLinkGroups; ++group)
+        linkBox.addItem("Link " + String::charToString((juce_wchar) ('A' + group - 1)), group + 1);
+    linkBox.setSelectedId(audioProcessor.getLinkGroup() + 1, juce::NotificationType::dontSendNotification);
+    linkBox.onChange = [this] {
+        audioProcessor.setLinkGroup(linkBox.getSelectedId() - 1);
+        shownProgram = audioProcessor.getActiveProgram();
+        updateBoxes(&audioProcessor);
+        selectShownMakam();
+    };
+
+    // setup "Export" button: the table in use as Scala and AnaMark tunings, for synths with native tuning
+    exportBtn.setButtonText("Export...");
+    exportBtn.setTooltip("Save the makam in use as .scl + .kbm (Scala) and .tun (AnaMark)");
+    exportBtn.setColour(juce::TextButton::buttonColourId, juce::Colours::black);
+    exportBtn.setColour(juce::TextButton::textColourOffId, juce::Colours::darkgoldenrod);
+    exportBtn.onClick = [this] { exportScale(); };
+
+    // setup block timing stats: p50, p99 and max of the block time, the whole summary as tooltip
+    timingLabel.setColour(juce::Label::textColourId, juce::Colours::darkgoldenrod);
+    timingResetBtn.setButtonText("Reset");
+    timingResetBtn.setTooltip("Start the block timing statistics again");
+    timingResetBtn.setColour(juce::TextButton::buttonColourId, juce::Colours::black);
+    timingResetBtn.setColour(juce::TextButton::textColourOffId, juce::Colours::darkgoldenrod);
+    timingResetBtn.onClick = [this] { audioProcessor.clearProfiler(); };
+
+    // setup "Notes" button, cycling through the pages of 16 notes
+    pageBtn.setColour(juce::TextButton::buttonColourId, juce::Colours::black);
+    pageBtn.setColour(juce::TextButton::textColourOffId, juce::Colours::darkgoldenrod);
+    pageBtn.onClick = [this] {
+        page++;
+        if (page * 16 >= countScaleNotes())
+            page = 0;
+        updateBoxes(&audioProcessor);
+    };
+
     addAndMakeVisible(upperBox);
     addAndMakeVisible(loadBtn);
+    addAndMakeVisible(pageBtn);
+    addAndMakeVisible(makamBox);
+    addAndMakeVisible(exportBtn);
     addAndMakeVisible(exModeBtn);
+    addAndMakeVisible(bendRangeBox);
+    addAndMakeVisible(outputModeBox);
+    addAndMakeVisible(linkBox);
+    addChildComponent(timingLabel);
+    addChildComponent(timingResetBtn);
     
     for (int i = 0; i < 16; i++)
     {
-        lowControls[i] = std::make_unique<LowBox>(audioProcessor.apvts, i + 1);
+        lowControls[i] = std::make_unique<LowBox>(i + 1);
         lowControls[i]->note->onChange = [this, i] {
-            updateAlteration(i, false);
+            updateAlteration(i);
         };
         lowControls[i]->alteration->onChange = [this, i] {
-            updateAlteration(i, false);
+            updateAlteration(i);
         };
         lowControls[i]->toggle->onStateChange = [this, i] {
-            updateAlteration(i, false);
+            updateAlteration(i);
         };
 
         addAndMakeVisible(*lowControls[i]);
@@ -120,10 +173,14 @@ MidiEffectAudioProcessorEditor::MidiEffectAudioProcessorEditor (MidiEffectAudioP
 
     // for persistence of the GUI when the plugin window gets closed
     updateBoxes(&audioProcessor);
+
+    shownProgram = audioProcessor.getActiveProgram();
+    startTimerHz(15);
 }
 
 MidiEffectAudioProcessorEditor::~MidiEffectAudioProcessorEditor()
 {
+    audioProcessor.library->removeChangeListener(this);
     setLookAndFeel(nullptr);
 }
 
@@ -165,7 +222,17 @@ void MidiEffectAudioProcessorEditor::resized()
     const auto btnHeight = btnWidth * 0.5;
 
     loadBtn.setBounds(btnX, btnY, btnWidth, btnHeight);
+    pageBtn.setBounds(btnX, loadBtn.getBottom() + 2, btnWidth, upperBox.getBottom() - loadBtn.getBottom() - 4);
+    makamBox.setBounds(loadBtn.getRight() + btnX / 2, btnY + btnHeight / 4, btnWidth * 1.6, btnHeight / 2);
+    exportBtn.setBounds(makamBox.getBounds().translated(0, makamBox.getHeight() + 4).withWidth(btnWidth));
     exModeBtn.setBounds(getWidth()*(1-0.035) - btnWidth, btnY, btnWidth, btnHeight);
+    bendRangeBox.setBounds(exModeBtn.getX() - btnWidth - btnX / 2, btnY + btnHeight / 4, btnWidth, btnHeight / 2);
+    linkBox.setBounds(bendRangeBox.getBounds().translated(0, bendRangeBox.getHeight() + 4));
+    outputModeBox.setBounds(exModeBtn.getBounds().withY(linkBox.getY()).withHeight(linkBox.getHeight()));
+
+    // block timing between the makam and the synth settings
+    timingResetBtn.setBounds(bendRangeBox.getX() - btnX / 2 - btnWidth / 2, exportBtn.getY(), btnWidth / 2, exportBtn.getHeight());
+    timingLabel.setBounds(exportBtn.getRight() + btnX / 2, exportBtn.getY(), timingResetBtn.getX() - exportBtn.getRight() - btnX / 2, exportBtn.getHeight());
 
     for (int i = 0; i < N/2; i++) {
         lowControls[i]->setBounds(firstControlRowBounds.removeFromLeft(boxWidth));
@@ -177,27 +244,220 @@ void MidiEffectAudioProcessorEditor::resized()
 
 }
 
+void MidiEffectAudioProcessorEditor::changeListenerCallback(juce::ChangeBroadcaster*)
+{
+    updateMakamList();
+}
+
+void MidiEffectAudioProcessorEditor::timerCallback()
+{
+    updateTimingStats();
+
+    // follow Program Change, keyswitches, host automation and linked instances
+    const int program = audioProcessor.getActiveProgram();
+    if (program == shownProgram && audioProcessor.getAlterations() == shownTable)
+        return;
+
+    shownProgram = program;
+    updateBoxes(&audioProcessor);
+    selectShownMakam();
+}
+
+// shows the block timing histograms while the audio thread fills them
+void MidiEffectAudioProcessorEditor::updateTimingStats()
+{
+    const bool timing = audioProcessor.apvts.getRawParameterValue("Block Timing")->load() > 0.5f;
+    timingLabel.setVisible(timing);
+    timingResetBtn.setVisible(timing);
+
+    if (!timing)
+        return;
+
+    const auto& profiler = audioProcessor.getProfiler();
+    const auto block = profiler.getBlockTimes();
+
+    if (block.count == 0)
+    {
+        timingLabel.setText("No block timed yet", juce::NotificationType::dontSendNotification);
+        timingLabel.setTooltip({});
+        return;
+    }
+
+    timingLabel.setText(String::formatted("Block p50 %.1f  p99 %.1f  max %.1f us", block.p50, block.p99, block.max),
+                        juce::NotificationType::dontSendNotification);
+
+    char summary[512];
+    if (profiler.formatSummary(summary, sizeof(summary)) > 0)
+        timingLabel.setTooltip(String(summary).trim());
+}
+
+// selects the makam in use in the makam box, or nothing if the table doesn't come from the library
+void MidiEffectAudioProcessorEditor::selectShownMakam()
+{
+    const auto name = audioProcessor.getMakamName();
+
+    for (int i = 0; i < (int) makamIndex->size(); ++i)
+    {
+        const auto& entry = (*makamIndex)[(size_t) i];
+        if (entry.isValid() && name.isNotEmpty() && entry.name == name)
+        {
+            makamBox.setSelectedId(i + 1, juce::NotificationType::dontSendNotification);
+            return;
+        }
+    }
+
+    makamBox.setSelectedId(0, juce::NotificationType::dontSendNotification);
+}
+
+// fills the makam box from the library, one section per family
+void MidiEffectAudioProcessorEditor::updateMakamList()
+{
+    makamIndex = audioProcessor.library->getIndex();
+    makamBox.clear(juce::NotificationType::dontSendNotification);
+
+    String family;
+    for (int i = 0; i < (int) makamIndex->size(); ++i)
+    {
+        const auto& entry = (*makamIndex)[(size_t) i];
+        if (!entry.isValid())
+            continue;
+
+        if (entry.family != family)
+        {
+            family = entry.family;
+            makamBox.addSectionHeading(family);
+        }
+
+        makamBox.addItem(entry.name, i + 1);
+    }
+
+    makamBox.addSeparator();
+    makamBox.addItem("Add scale folder...", addFolderItemId);
+    selectShownMakam();
+}
+
+void MidiEffectAudioProcessorEditor::makamSelected()
+{
+    const int id = makamBox.getSelectedId();
+
+    if (id == addFolderItemId)
+    {
+        makamBox.setSelectedId(0, juce::NotificationType::dontSendNotification);
+
+        fileChooser = std::make_unique<juce::FileChooser>("Choose a folder of scales", audioProcessor.root);
+        fileChooser->launchAsync(juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectDirectories,
+            [this](const juce::FileChooser& chooser) {
+                if (chooser.getResult().isDirectory())
+                    audioProcessor.library->addUserDirectory(chooser.getResult());
+            });
+        return;
+    }
+
+    if (id < 1 || id > (int) makamIndex->size())
+        return;
+
+    audioProcessor.selectMakam((*makamIndex)[(size_t) (id - 1)]);
+    shownProgram = audioProcessor.getActiveProgram();
+    updateBoxes(&audioProcessor);
+}
+
+// saves the table in use next to each other as name.scl, name.kbm and name.tun
+void MidiEffectAudioProcessorEditor::exportScale()
+{
+    auto table = audioProcessor.getAlterations();
+    auto name = audioProcessor.getMakamName();
+    if (name.isEmpty())
+        name = "MakaMIDI";
+
+    fileChooser = std::make_unique<juce::FileChooser>("Export the makam as", audioProcessor.root.getChildFile(name + ".scl"), "*.scl");
+    fileChooser->launchAsync(juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::warnAboutOverwriting,
+        [table, name](const juce::FileChooser& chooser) {
+            const auto file = chooser.getResult();
+            if (file == juce::File())
+                return;
+
+            const auto scaleName = file.getFileNameWithoutExtension().toStdString();
+            const bool written = file.withFileExtension(".scl").replaceWithText(TuningExport::toScl(*table, scaleName))
+                              && file.withFileExtension(".kbm").replaceWithText(TuningExport::toKbm(*table, scaleName))
+                              && file.withFileExtension(".tun").replaceWithText(TuningExport::toTun(*table, scaleName));
+
+            if (!written)
+                AlertWindow::showMessageBoxAsync(AlertWindow::WarningIcon, "Export failed",
+                                                 "Cannot write the tuning files of " + name + " in " + file.getParentDirectory().getFullPathName());
+        });
+}
+
+// lists what went wrong while reading a scale (the first few problems only)
+void MidiEffectAudioProcessorEditor::showDiagnostics(const juce::File& file, const ScaleParseResult& result)
+{
+    const int maxShown = 8;
+    String text;
+
+    for (size_t i = 0; i < result.diagnostics.size() && i < (size_t) maxShown; ++i)
+    {
+        const auto& d = result.diagnostics[i];
+        text << (d.severity == ScaleDiagnostic::Severity::error ? "Error" : "Warning");
+        if (d.line > 0)
+            text << " (line " << d.line << ")";
+        text << ": " << String(d.message) << "\n";
+    }
+
+    if (result.diagnostics.size() > (size_t) maxShown)
+        text << "... and " << (int) (result.diagnostics.size() - (size_t) maxShown) << " more\n";
+
+    if (result.hasErrors())
+        text << "\nThe scale was not loaded.";
+
+    AlertWindow::showMessageBoxAsync(result.hasErrors() ? AlertWindow::WarningIcon : AlertWindow::InfoIcon,
+                                     file.getFileName(), text);
+}
+
+int MidiEffectAudioProcessorEditor::countScaleNotes()
+{
+    auto alterations = audioProcessor.getAlterations();
+    int count = 0;
+    for (int i = 0; i < 128; i++)
+        if (!alterations->isExcluded(i))
+            count++;
+    return count;
+}
+
 // once a scale file has been read, this function updates the ComboBoxes on the GUI
 void MidiEffectAudioProcessorEditor::updateBoxes(MidiEffectAudioProcessor* p)
 {
-    // boxnum counts how many notes the scale is using, a maximum of 16 is shown
+    // don't write what is being shown back to the table
+    const juce::ScopedValueSetter<bool> svs(updatingBoxes, true);
+
+    auto alterations = p->getAlterations();
+    shownTable = alterations;
+
+    // pages of 16 boxes: the scale can use any number of notes
+    const int numNotes = countScaleNotes();
+
+    const int numPages = jmax(1, (numNotes + 15) / 16);
+    page = jlimit(0, numPages - 1, page);
+    pageBtn.setButtonText("Notes " + String(page * 16 + 1) + "-" + String(jmax(page * 16 + 1, jmin(numNotes, page * 16 + 16)))
+                          + (numPages > 1 ? " >" : ""));
+    pageBtn.setEnabled(numPages > 1);
+
+    // boxnum counts how many notes of the page are shown, skipped how many notes belong to previous pages
     int boxnum = 0;
+    int skipped = 0;
 
     // for each noteNumber
     for (int i = 0; i < 128; i++)
     {
         // if there is a record in the alterations
-        if (p->alterations[i]!=std::numeric_limits<int>::max()) {
-            DBG("Loading alteration[" << String(i) << "]: " + String(p->alterations[i]));
-            //DBG("Alterations[" << String(i) << "]: " << String(p->alterations[i]));
+        if (!alterations->isExcluded(i) && skipped++ >= page * 16) {
+            DBG("Loading alteration[" << String(i) << "]: " + String((*alterations)[i]));
             // fill a ComboBox with the corresponding couple note+alteration
-            lowControls[boxnum]->setAlteration(i, p->alterations[i]);
+            lowControls[boxnum]->setAlteration(i, (*alterations)[i]);
             int temp = lowControls[boxnum]->alteration->getSelectedId()-11;
             DBG("Alteration set for note " << String(i) << ": " << String(temp));
             boxnum++;
         }
 
-        // if more than 15 alterations are loaded, don't show the remaining ones
+        // the remaining alterations are on the next pages
         if (boxnum > 15)
             break;
     }
@@ -211,19 +471,16 @@ void MidiEffectAudioProcessorEditor::updateBoxes(MidiEffectAudioProcessor* p)
  * @brief Updates the alteration for the note controlled by LowBox at index i.
  *
  * Called when the user changes the toggle, note, or alteration controls.
- * Updates the corresponding entry in the processor's `alterations` array
+ * Publishes the corresponding entry of the processor's tuning table
  * if the controls are in a valid state.
  *
  * @param i Index of the LowBox (0-based).
  */
-void MidiEffectAudioProcessorEditor::updateAlteration(int i, bool onLoad)
+void MidiEffectAudioProcessorEditor::updateAlteration(int i)
 {
-    if(!onLoad && audioProcessor.readingScale)
-    {
-        // If called on load, skip the update
-        DBG("updateAlteration - Skipped during loading");
+    // the table already holds what the boxes are being set to
+    if (updatingBoxes)
         return;
-    }
 
     // Reset temporaneo della nota target
     int j = lowControls[i]->note->getSelectedId() + 10;
@@ -233,14 +490,18 @@ void MidiEffectAudioProcessorEditor::updateAlteration(int i, bool onLoad)
         lowControls[i]->alteration->getSelectedId() > 1)
     {
         int alt = lowControls[i]->alteration->getSelectedId() - 11;
-        audioProcessor.alterations.set(j, alt);
+        audioProcessor.setAlteration(j, alt);
         DBG("updateAlteration - MIDInote: " << j << " alt: " << alt);
-        DBG("\t\t\t\t: " << lowControls[i]->note->getText() << " alt: " << audioProcessor.alterations[j]);
     }
     else
     {
         // Disattiva se la combo o toggle è inattiva
-        audioProcessor.alterations.set(j, std::numeric_limits<int>::max());
+        audioProcessor.setAlteration(j, TuningTable::excluded);
         DBG("updateAlteration - MIDInote: " << j << " reset");
     }
+
+    // the table no longer matches a library entry; the boxes already show the edit
+    shownProgram = audioProcessor.getActiveProgram();
+    shownTable = audioProcessor.getAlterations();
+    makamBox.setSelectedId(0, juce::NotificationType::dontSendNotification);
 }
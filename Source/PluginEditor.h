@@ -34,7 +34,9 @@ struct Placeholder : Component
 
 /**
 */
-class MidiEffectAudioProcessorEditor  : public juce::AudioProcessorEditor
+class MidiEffectAudioProcessorEditor  : public juce::AudioProcessorEditor,
+                                        private juce::ChangeListener,
+                                        private juce::Timer
 {
 public:
     MidiEffectAudioProcessorEditor (MidiEffectAudioProcessor&);
@@ -45,18 +47,57 @@ public:
     void resized() override;
     void updateBoxes(MidiEffectAudioProcessor* p);
     void updateAlterations();
-    void updateAlteration(int i, bool onLoad);
+    void updateAlteration(int i);
+    void showDiagnostics(const juce::File& file, const ScaleParseResult& result);
+    void updateMakamList();
+    int countScaleNotes();
 
 private:
+    void changeListenerCallback(juce::ChangeBroadcaster* source) override;
+    void timerCallback() override;
+    void makamSelected();
+    void exportScale();
+    void selectShownMakam();
+    void updateTimingStats();
+
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
     MidiEffectAudioProcessor& audioProcessor;
 
     // GUI Components
-    juce::TextButton loadBtn, exModeBtn;
+    juce::TextButton loadBtn, exModeBtn, pageBtn, exportBtn;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ButtonAttachment> exModeAttachment;
+
+    // page of 16 notes shown in the boxes
+    int page = 0;
+
+    // makam scales indexed by the library, plus an item to add a folder to it
+    juce::ComboBox makamBox;
+    std::shared_ptr<const MakamLibrary::Index> makamIndex;
+    static constexpr int addFolderItemId = 10000;
+
+    // program last shown, to follow Program Change and keyswitches coming from the audio thread
+    int shownProgram = -1;
+    std::shared_ptr<const TuningTable> shownTable;
+
+    // link group shared with other instances
+    juce::ComboBox linkBox;
+
+    // pitch bend range of the downstream synth
+    juce::ComboBox bendRangeBox;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> bendRangeAttachment;
+    juce::ComboBox outputModeBox;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> outputModeAttachment;
 
     std::unique_ptr<juce::FileChooser> fileChooser;
 
+    // block timing of the audio thread while "Block Timing" is on, and a button that starts it again
+    juce::Label timingLabel;
+    juce::TextButton timingResetBtn;
+
+    // shows the tooltips of the boxes, buttons and timing stats
+    juce::TooltipWindow tooltipWindow { this };
+
     // labels on left side indicating rows of notes and alterations (2x2=4 rows)
     juce::Label noteLabel1, alterationLabel1, noteLabel2, alterationLabel2;
 
@@ -66,10 +107,11 @@ private:
     // 16 control box (note and relative alteration)
     std::unique_ptr<LowBox> lowControls[16];
 
-    // attachments for the 16 controls
-    juce::AudioProcessorValueTreeState::ButtonAttachment* buttonAttachments[16];
 
     Image bgImg;
 
+    // true while updateBoxes mirrors the processor's table into the controls
+    bool updatingBoxes = false;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MidiEffectAudioProcessorEditor)
 };
@@ -14,30 +14,293 @@
 #include "MidiProcessor.h"
 #include "LowBox.h"
 
-/* 
+void MidiEffectAudioProcessor::printAlterations()
+{
+    auto alterations = getAlterations();
+    for (int i = 70; i < 100; i++)
+        DBG("note " << i << ": " << (*alterations)[i]);
+}
+
+/*
     @brief
-    returns integer alteration [-9, 9] from the string value, if valid
+    publishes a whole new table: the audio thread picks it up at its next block
 */
-int MidiEffectAudioProcessor::parseCommas(String commas) {
-    // if the field contains N, the alteration is NaN, thus the note is interpreted as not in the scale
-    if (commas.indexOf("N")>=0)
-        return std::numeric_limits<int>::max();
-
-    int numCommas = commas.getIntValue();
-    if (numCommas > -10 && numCommas < 10)
-        return commas.getIntValue();
-    else
+void MidiEffectAudioProcessor::setAlterations(const TuningTable& newAlterations)
+{
+    // identical tables are shared by every instance in the process
+    auto table = pool->intern(newAlterations);
+    applyTuning(table, {});
+    pool->publishToGroup(this, table, {});
+}
+
+void MidiEffectAudioProcessor::setAlteration(int noteNumber, int alteration)
+{
+    auto alterations = *getAlterations();
+    alterations.set(noteNumber, alteration);
+    setAlterations(alterations);
+}
+
+std::shared_ptr<const TuningTable> MidiEffectAudioProcessor::getAlterations() const
+{
+    if (auto programTable = bank.get()->getShared(currentProgram.load()))
+        return programTable;
+    return tuning.get();
+}
+
+void MidiEffectAudioProcessor::selectMakam(const MakamEntry& entry)
+{
+    if (!entry.isValid())
+        return;
+
+    // the library's table is immutable, so it can be shared as is
+    applyTuning(entry.table, entry.name);
+    pool->publishToGroup(this, entry.table, entry.name.toStdString());
+}
+
+juce::String MidiEffectAudioProcessor::getMakamName()
+{
+    const int program = currentProgram.load();
+    return program >= 0 ? getProgramName(program) : makamName;
+}
+
+/*
+    @brief
+    makes table the editable table and switches to the library program with the same name, if any
+    (the edited table takes over from any bank program otherwise)
+*/
+void MidiEffectAudioProcessor::applyTuning(std::shared_ptr<const TuningTable> table, const juce::String& name)
+{
+    tuning.publish(table);
+    makamName = name;
+
     {
-        DBG("INVALID PITCH DATA: " << commas);
-        throw(std::range_error("Cannot convert commas to a valid pitch bend value"));
-        return 0;
+        const juce::ScopedLock sl(programNamesLock);
+        requestProgram(name.isEmpty() ? -1 : programNames.indexOf(name));
     }
+
+    // supersedes whatever the audio thread built from automation meanwhile. The parameters move last:
+    // by the time the audio thread sees them, they match the table it is about to use
+    ++tuningGeneration;
+    syncParameters(*table);
 }
 
-void MidiEffectAudioProcessor::printAlterations()
+void MidiEffectAudioProcessor::linkedTuningChanged(const std::shared_ptr<const TuningTable>& table, const std::string& name)
 {
-    for (int i = 70; i < 100; i++)
-        DBG("note " << i << ": " << alterations[i]);
+    applyTuning(table, juce::String(name));
+}
+
+void MidiEffectAudioProcessor::setLinkGroup(int group)
+{
+    linkGroup = juce::jlimit(0, TuningPool::numLinkGroups, group);
+    pool->setLinkGroup(this, linkGroup);
+}
+
+/*
+    @brief
+    asks the audio thread to switch program at the start of its next block
+*/
+void MidiEffectAudioProcessor::requestProgram(int program)
+{
+    currentProgram.store(program);
+    requestedProgram.store(program);
+}
+
+// the bank mirrors the library: every valid entry becomes a program
+void MidiEffectAudioProcessor::rebuildBank()
+{
+    const auto previousName = getMakamName();
+    const bool programActive = currentProgram.load() >= 0;
+
+    auto newBank = std::make_shared<TuningBank>();
+    juce::StringArray names;
+
+    for (auto& entry : *library->getIndex())
+    {
+        if (!entry.isValid() || newBank->numPrograms >= TuningBank::maxPrograms)
+            continue;
+
+        newBank->add(entry.table);
+        names.add(entry.name);
+    }
+
+    {
+        const juce::ScopedLock sl(programNamesLock);
+        programNames = names;
+    }
+
+    bank.publish(std::move(newBank));
+
+    // programs may have moved: follow the one in use by name
+    if (programActive)
+        requestProgram(names.indexOf(previousName));
+
+    updateHostDisplay(juce::AudioProcessorListener::ChangeDetails().withProgramChanged(true));
+}
+
+void MidiEffectAudioProcessor::changeListenerCallback(juce::ChangeBroadcaster*)
+{
+    rebuildBank();
+}
+
+//==============================================================================
+int MidiEffectAudioProcessor::toParameterValue(int alteration)
+{
+    return alteration == TuningTable::excluded ? excludedParameterValue : alteration;
+}
+
+int MidiEffectAudioProcessor::fromParameterValue(int value)
+{
+    return value == excludedParameterValue ? TuningTable::excluded : value;
+}
+
+// moves the parameters that differ from the table, so that the host sees what is playing
+void MidiEffectAudioProcessor::syncParameters(const TuningTable& table)
+{
+    for (int i = 0; i < TuningTable::numNotes; ++i)
+    {
+        auto* param = alterationParameters[(size_t) i];
+        const int value = toParameterValue(table[i]);
+
+        if (param->get() != value)
+            param->setValueNotifyingHost(param->convertTo0to1((float) value));
+    }
+}
+
+// may be called on any thread, host automation included: only mark the note
+void MidiEffectAudioProcessor::parameterValueChanged(int parameterIndex, float)
+{
+    const int note = parameterIndex - firstAlterationParameterIndex;
+
+    if (juce::isPositiveAndBelow(note, TuningTable::numNotes))
+    {
+        const auto bit = (std::uint64_t) 1 << (note & 63);
+        dirtyNotes[(size_t) (note >> 6)].fetch_or(bit);
+        automatedNotes[(size_t) (note >> 6)].fetch_or(bit);
+    }
+}
+
+/*
+    @brief
+    audio thread side of the alteration parameters: when notes were marked since the last block,
+    reads their raw values and, if they differ from the table in use, plays a local copy of the editable
+    table with the new values until the message thread publishes the same changes.
+    Returns the table to use as the editable table for this block
+*/
+const TuningTable& MidiEffectAudioProcessor::applyAutomation(const TuningTable& editableTable, const TuningBank& programs)
+{
+    // a table was published after the automated one: it already contains the changes, or overrides them
+    const auto generation = tuningGeneration.load();
+    if (generation != automatedGeneration)
+    {
+        automatedGeneration = generation;
+        automationActive = false;
+    }
+
+    const TuningTable& editable = automationActive ? automatedTable : editableTable;
+    const std::array<std::uint64_t, 2> marked { automatedNotes[0].load(), automatedNotes[1].load() };
+
+    if ((marked[0] | marked[1]) == 0)
+        return editable;
+
+    const TuningTable& inUse = programs.select(editable, activeProgram);
+    const auto automatedValue = [this](int note) { return fromParameterValue(roundToInt(alterationValues[(size_t) note]->load())); };
+
+    // calls function(note) for every marked note
+    const auto forEachMarked = [&marked](auto&& function)
+    {
+        for (size_t word = 0; word < marked.size(); ++word)
+        {
+            for (auto bits = marked[word]; bits != 0; bits &= bits - 1)
+            {
+                int bit = 0;
+                while (((bits >> bit) & 1) == 0)
+                    ++bit;
+
+                function((int) word * 64 + bit);
+            }
+        }
+    };
+
+    bool changed = false;
+    forEachMarked([&](int note) { changed = changed || automatedValue(note) != inUse[note]; });
+
+    // a table published meanwhile may not hold these values: the marks stay for the next block, which starts from it
+    if (tuningGeneration.load() != generation)
+        return editable;
+
+    for (size_t word = 0; word < marked.size(); ++word)
+        automatedNotes[word].fetch_and(~marked[word]);
+
+    if (!changed)
+        return editable;
+
+    // like an edit from the GUI, the automated table takes over from any bank program. Only the first
+    // change after a publish or a program switch copies the table in use, later ones edit it in place
+    if (&inUse != &automatedTable)
+        automatedTable = inUse;
+
+    forEachMarked([&](int note) {
+        if (automatedValue(note) != automatedTable[note])
+            automatedTable.set(note, automatedValue(note));
+    });
+
+    automationActive = true;
+    midiProcessor.requestProgram(-1);
+    return automatedTable;
+}
+
+/*
+    @brief
+    turns the alteration parameters changed since the last call (by the host or by automation) into a new table.
+    Only the marked notes are read, and nothing is published if they already match the table in use
+*/
+void MidiEffectAudioProcessor::applyParameterChanges()
+{
+    TuningTable alterations = *getAlterations();
+
+    if (readParameterChanges({ dirtyNotes[0].exchange(0), dirtyNotes[1].exchange(0) }, alterations))
+        setAlterations(alterations);
+}
+
+// sets the notes marked in notes to their alteration parameter; returns false if they all matched already
+bool MidiEffectAudioProcessor::readParameterChanges(const std::array<std::uint64_t, 2>& notes, TuningTable& alterations) const
+{
+    bool changed = false;
+
+    for (size_t word = 0; word < notes.size(); ++word)
+    {
+        for (auto bits = notes[word]; bits != 0; bits &= bits - 1)
+        {
+            int bit = 0;
+            while (((bits >> bit) & 1) == 0)
+                ++bit;
+
+            const int note = (int) word * 64 + bit;
+            const int alteration = fromParameterValue(alterationParameters[(size_t) note]->get());
+
+            if (alteration != alterations[note])
+            {
+                alterations.set(note, alteration);
+                changed = true;
+            }
+        }
+    }
+
+    return changed;
+}
+
+void MidiEffectAudioProcessor::timerCallback()
+{
+    // a Program Change or keyswitch switched table: show it to the host
+    const int program = currentProgram.load();
+    if (program != syncedProgram)
+    {
+        syncedProgram = program;
+        syncParameters(*getAlterations());
+    }
+
+    applyParameterChanges();
+    updateLatency();
 }
 
 //==============================================================================
@@ -56,11 +319,49 @@ MidiEffectAudioProcessor::MidiEffectAudioProcessor()
     // Find VST's directory
     root = juce::File::getSpecialLocation(juce::File::currentExecutableFile)
         .getParentDirectory().getParentDirectory().getParentDirectory();
-    alterations.insertMultiple(0, std::numeric_limits<int>::max(), 128);
+    bendRangeParameter = apvts.getRawParameterValue("Bend Range");
+    programChangeParameter = apvts.getRawParameterValue("Program Change");
+    keyswitchParameter = apvts.getRawParameterValue("Keyswitch");
+    exclusiveParameter = apvts.getRawParameterValue("Exclusive");
+    directionHysteresisParameter = apvts.getRawParameterValue("Direction Hysteresis");
+    independentChannelsParameter = apvts.getRawParameterValue("Independent Channels");
+    outputModeParameter = apvts.getRawParameterValue("Output Mode");
+    wheelRateParameter = apvts.getRawParameterValue("Wheel Rate");
+    wheelResolutionParameter = apvts.getRawParameterValue("Wheel Resolution");
+    preBendParameter = apvts.getRawParameterValue("Pre-bend");
+    glideParameter = apvts.getRawParameterValue("Glide");
+    vibratoDepthParameter = apvts.getRawParameterValue("Vibrato Depth");
+    vibratoRateParameter = apvts.getRawParameterValue("Vibrato Rate");
+    vibratoSyncParameter = apvts.getRawParameterValue("Vibrato Sync");
+    expressionDensityParameter = apvts.getRawParameterValue("Expression Density");
+    traceParameter = apvts.getRawParameterValue("Trace");
+    blockTimingParameter = apvts.getRawParameterValue("Block Timing");
+    timingTraceParameter = apvts.getRawParameterValue("Timing Trace");
+
+    for (int i = 0; i < TuningTable::numNotes; ++i)
+    {
+        auto* param = dynamic_cast<juce::AudioParameterInt*>(apvts.getParameter(getAlterationParameterID(i)));
+        jassert(param != nullptr);
+        alterationParameters[(size_t) i] = param;
+        alterationValues[(size_t) i] = apvts.getRawParameterValue(getAlterationParameterID(i));
+        param->addListener(this);
+    }
+
+    firstAlterationParameterIndex = alterationParameters[0]->getParameterIndex();
+
+    library->addChangeListener(this);
+    rebuildBank();
+
+    startTimerHz(20);
 }
 
 MidiEffectAudioProcessor::~MidiEffectAudioProcessor()
 {
+    stopTimer();
+    for (auto* param : alterationParameters)
+        param->removeListener(this);
+    pool->setLinkGroup(this, 0);
+    library->removeChangeListener(this);
 }
 
 //==============================================================================
@@ -103,22 +404,27 @@ double MidiEffectAudioProcessor::getTailLengthSeconds() const
 
 int MidiEffectAudioProcessor::getNumPrograms()
 {
-    return 1;   // NB: some hosts don't cope very well if you tell them there are 0 programs,
-                // so this should be at least 1, even if you're not really implementing programs.
+    const juce::ScopedLock sl(programNamesLock);
+    return juce::jmax(1, programNames.size());   // NB: some hosts don't cope very well if you tell them there are 0 programs,
+                                                // so this should be at least 1, even if you're not really implementing programs.
 }
 
 int MidiEffectAudioProcessor::getCurrentProgram()
 {
-    return 0;
+    return juce::jmax(0, currentProgram.load());
 }
 
 void MidiEffectAudioProcessor::setCurrentProgram (int index)
 {
+    const juce::ScopedLock sl(programNamesLock);
+    if (juce::isPositiveAndBelow(index, programNames.size()))
+        requestProgram(index);
 }
 
 const juce::String MidiEffectAudioProcessor::getProgramName (int index)
 {
-    return {};
+    const juce::ScopedLock sl(programNamesLock);
+    return programNames[index];
 }
 
 void MidiEffectAudioProcessor::changeProgramName (int index, const juce::String& newName)
@@ -127,47 +433,81 @@ void MidiEffectAudioProcessor::changeProgramName (int index, const juce::String&
 
 //============================================================================== 
 
-void MidiEffectAudioProcessor::readScale(const juce::File& fileToRead)
+/*
+    @brief
+    reads a scale CSV or a compiled tuning and publishes it, unless the file has errors.
+    The file is memory mapped when possible and parsed in a single pass over its bytes.
+*/
+ScaleParseResult MidiEffectAudioProcessor::readScale(const juce::File& fileToRead)
 {
-    if (!fileToRead.existsAsFile()) {
-        DBG("File not found");
-        return;
-    }
-
-    juce::FileInputStream inputStream(fileToRead); 
+    ScaleParseResult result;
 
-    if (!inputStream.openedOk())
+    if (!fileToRead.existsAsFile())
     {
-        DBG("\nFailed to open file\n");
-        return;
+        result.diagnostics.push_back({ ScaleDiagnostic::Severity::error, 0, "file not found" });
+        return result;
     }
 
-    if (alterations.size() > 0)
-        alterations.clear();
+    juce::MemoryMappedFile mappedFile(fileToRead, juce::MemoryMappedFile::readOnly);
 
-    for (int i = 0; i < 128; i++)
+    if (mappedFile.getData() != nullptr)
     {
-        alterations.set(i, std::numeric_limits<int>::max());
-        //DBG("DBG nan: " << alterations[i]);
+        result = ScaleParser::parse(mappedFile.getData(), mappedFile.getSize());
     }
-
-    while (!inputStream.isExhausted())
+    else
     {
-        auto line = inputStream.readNextLine();
+        juce::MemoryBlock contents;
 
-        int noteNumber = line.upToFirstOccurrenceOf(",", false, true).getIntValue();
+        if (!fileToRead.loadFileAsData(contents))
+        {
+            result.diagnostics.push_back({ ScaleDiagnostic::Severity::error, 0, "failed to open file" });
+            return result;
+        }
 
-        String altStr = line.fromFirstOccurrenceOf(",", false, true).upToFirstOccurrenceOf(",", false, true);
-        
-        DBG(altStr + " -> " + String(parseCommas(altStr)));
-        alterations.set(noteNumber, parseCommas(altStr));
+        result = ScaleParser::parse(contents.getData(), contents.getSize());
     }
 
+    if (!result.hasErrors())
+        setAlterations(result.table);
+
+    return result;
 }
 
 void MidiEffectAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    midiProcessor.exclusive = &exclusive;
+    midiProcessor.prepare(samplesPerBlock);
+
+    // configure the downstream synth's bend range as soon as playback starts
+    midiProcessor.setBendRange(roundToInt(bendRangeParameter->load()));
+    updateLatency();
+}
+
+int MidiEffectAudioProcessor::getPreBendSamples() const
+{
+    return roundToInt(preBendParameter->load() * getSampleRate() / 1000.0);
+}
+
+// vibrato period: a note value at the host's tempo when synced and the tempo is known, the rate otherwise
+int MidiEffectAudioProcessor::getVibratoPeriodSamples()
+{
+    static constexpr double syncBeats[] = { 0.0, 1.0, 1.0 / 2.0, 1.0 / 3.0, 1.0 / 4.0, 1.0 / 6.0, 1.0 / 8.0 };
+    const int sync = jlimit(0, (int) std::size(syncBeats) - 1, roundToInt(vibratoSyncParameter->load()));
+
+    if (sync > 0)
+        if (auto* playHead = getPlayHead())
+            if (auto position = playHead->getPosition())
+                if (auto bpm = position->getBpm(); bpm.hasValue() && *bpm > 0.0)
+                    return roundToInt(syncBeats[sync] * 60.0 / *bpm * getSampleRate());
+
+    return roundToInt(getSampleRate() / vibratoRateParameter->load());
+}
+
+// the pre-bend lookahead delays the output: the host compensates for it (message thread)
+void MidiEffectAudioProcessor::updateLatency()
+{
+    const int samples = getPreBendSamples();
+    if (samples != getLatencySamples())
+        setLatencySamples(samples);
 }
 
 void MidiEffectAudioProcessor::releaseResources()
@@ -205,7 +545,50 @@ bool MidiEffectAudioProcessor::isBusesLayoutSupported (const BusesLayout& layout
 void MidiEffectAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
     buffer.clear(); // silence any possible disturbance
-    pitchCorrection = midiProcessor.process(midiMessages, &pitchWheelValue, &pitchCorrection, alterations, &activeNoteNumber);
+
+    const int bendRange = roundToInt(bendRangeParameter->load());
+    if (bendRange != midiProcessor.getBendRange())
+        midiProcessor.setBendRange(bendRange);
+
+    midiProcessor.setSwitching(programChangeParameter->load() > 0.5f, roundToInt(keyswitchParameter->load()));
+    midiProcessor.setExclusive(exclusiveParameter->load() > 0.5f);
+    midiProcessor.setDirectionHysteresis(roundToInt(directionHysteresisParameter->load()));
+    midiProcessor.setOutputMode((OutputMode) roundToInt(outputModeParameter->load()));
+    midiProcessor.setIndependentChannels(independentChannelsParameter->load() > 0.5f);
+    midiProcessor.setTrace(traceParameter->load() > 0.5f ? &traceBuffer : nullptr);
+    midiProcessor.setProfiler(blockTimingParameter->load() > 0.5f ? &profiler : nullptr);
+    profiler.setTimeline(timingTraceParameter->load() > 0.5f);
+
+    midiProcessor.setPreBend(getPreBendSamples());
+
+    // glide and vibrato: milliseconds and events per millisecond to samples
+    midiProcessor.setExpression(roundToInt(glideParameter->load() * getSampleRate() / 1000.0),
+                                roundToInt(vibratoDepthParameter->load()),
+                                getVibratoPeriodSamples(),
+                                jmax(1, roundToInt(getSampleRate() / 1000.0 / expressionDensityParameter->load())));
+
+    // wheel thinning: events per second to an interval in samples, resolution in bits to a step
+    const int wheelRate = roundToInt(wheelRateParameter->load());
+    midiProcessor.setWheelThinning(wheelRate > 0 ? roundToInt(getSampleRate() / wheelRate) : 0,
+                                   1 << (2 * roundToInt(wheelResolutionParameter->load())));
+
+    const int request = requestedProgram.exchange(noProgramRequest);
+    if (request != noProgramRequest)
+        midiProcessor.requestProgram(request);
+
+    // one consistent table and bank for the whole block, whatever the editor publishes meanwhile
+    RealtimeSnapshot<TuningTable>::ScopedRead alterations(tuning);
+    RealtimeSnapshot<TuningBank>::ScopedRead programs(bank);
+
+    // alteration parameters automated since the last block, whether or not the message thread runs
+    const TuningTable& editableTable = applyAutomation(*alterations, *programs);
+
+    const int previousProgram = activeProgram;
+    pitchCorrection = midiProcessor.process(midiMessages, &pitchWheelValue, &pitchCorrection, editableTable, *programs, &activeProgram, &activeNoteNumber, buffer.getNumSamples());
+
+    // Program Change or keyswitch in this block
+    if (activeProgram != previousProgram)
+        currentProgram.store(activeProgram);
 }
 
 //==============================================================================
@@ -220,69 +603,253 @@ juce::AudioProcessorEditor* MidiEffectAudioProcessor::createEditor()
 }
 
 //==============================================================================
+/*
+    State layout (version 3):
+        int32   "MKST"
+        uint8   version
+        uint8   flags (bit 0: exclusive mode, also saved as the "Exclusive" parameter)
+        uint8   link group
+        uint8   reserved
+        int64   pool hash of the tuning table
+        int8    alteration of each of the 128 notes, -128 when excluded
+        string  makam name (empty if the table doesn't come from the library)
+        parameters that differ from their default: count, then (id, normalised value) pairs
+        bool    whether the table has ascending and descending alterations; if so,
+        int8    ascending alteration of each of the 128 notes, -128 when excluded
+        int8    descending alteration of each of the 128 notes, -128 when excluded
+
+    Older states still load: version 2 ends after the parameters, version 1 was the 128
+    alterations as raw 32-bit integers.
+*/
+static constexpr int stateMagic = 0x4d4b5354; // "MKST"
+static constexpr int stateVersion = 3;
+
 void MidiEffectAudioProcessor::getStateInformation(juce::MemoryBlock& destData)
 {
     juce::MemoryOutputStream stream(destData, true);
 
+    // what is playing, with the automation the timer hasn't published yet (it stays marked for the timer)
+    TuningTable table = *getAlterations();
+    const bool edited = readParameterChanges({ dirtyNotes[0].load(), dirtyNotes[1].load() }, table);
+
+    stream.writeInt(stateMagic);
+    stream.writeByte((char) stateVersion);
+    stream.writeByte((char) (exclusiveParameter->load() > 0.5f ? 1 : 0));
+    stream.writeByte((char) linkGroup);
+    stream.writeByte(0);
+    stream.writeInt64((juce::int64) TuningPool::hash(table));
+
     for (int i = 0; i < 128; ++i)
-        stream.writeInt(alterations[i]);
+        stream.writeByte((char) (table.isExcluded(i) ? -128 : table[i]));
+
+    // an edited table no longer comes from the library
+    stream.writeString(edited ? juce::String() : getMakamName());
+    writeParameters(stream);
+
+    // version 3: ascending and descending alterations, when the scale has them
+    stream.writeBool(table.hasDirections());
+    if (table.hasDirections())
+        for (auto direction : { TuningTable::ascending, TuningTable::descending })
+            for (int i = 0; i < 128; ++i)
+                stream.writeByte((char) (table.isExcluded(i) ? -128 : table.get(i, direction)));
 }
 
-
 void MidiEffectAudioProcessor::setStateInformation(const void* data, int sizeInBytes)
 {
     juce::MemoryInputStream stream(data, static_cast<size_t>(sizeInBytes), false);
+    TuningTable alterations;
+
+    // version 1
+    if (sizeInBytes == 128 * 4 && stream.readInt() != stateMagic)
+    {
+        stream.setPosition(0);
+
+        for (int i = 0; i < 128; ++i)
+        {
+            // anything outside the comma range would index past the bend tables
+            const int alteration = stream.readInt();
+            alterations.set(i, alteration > -10 && alteration < 10 ? alteration : TuningTable::excluded);
+        }
+
+        setAlterations(alterations);
+        return;
+    }
+
+    stream.setPosition(0);
+
+    const int version = stream.readInt() == stateMagic ? (int) (juce::uint8) stream.readByte() : -1;
+
+    if (version < 0 || version > stateVersion)
+    {
+        DBG("Unknown state format, ignored");
+        return;
+    }
+
+    const int flags = stream.readByte();
+    const int savedLinkGroup = stream.readByte();
+    stream.readByte();
+    const auto savedHash = (std::uint64_t) stream.readInt64();
 
     for (int i = 0; i < 128; ++i)
-        alterations.set(i, stream.readInt());
+    {
+        const int alteration = stream.readByte();
+        alterations.set(i, alteration > -10 && alteration < 10 ? alteration : TuningTable::excluded);
+    }
 
-}
+    const auto name = stream.readString();
+    readParameters(stream);
 
+    if (version >= 3 && stream.readBool())
+    {
+        int directional[2][128];
+
+        for (auto& values : directional)
+            for (auto& value : values)
+                value = stream.readByte();
+
+        for (int i = 0; i < 128; ++i)
+            if (!alterations.isExcluded(i) && directional[0][i] > -10 && directional[0][i] < 10 && directional[1][i] > -10 && directional[1][i] < 10)
+                alterations.setDirectional(i, alterations[i], directional[0][i], directional[1][i]);
+    }
+
+    // another instance probably uses this table already
+    auto table = pool->find(savedHash);
+    if (table == nullptr || *table != alterations)
+        table = pool->intern(alterations);
+
+    // states saved before exclusive mode became a parameter only have the flag
+    if (auto* exclusiveMode = apvts.getParameter("Exclusive"))
+        exclusiveMode->setValueNotifyingHost((flags & 1) != 0 ? 1.0f : 0.0f);
 
+    applyTuning(table, name);
+    setLinkGroup(savedLinkGroup);
+}
+
+bool MidiEffectAudioProcessor::isAlterationParameter(const juce::AudioProcessorParameter* param) const
+{
+    return juce::isPositiveAndBelow(param->getParameterIndex() - firstAlterationParameterIndex, TuningTable::numNotes);
+}
 
-juce::StringArray listAlterationsInCommas()
+void MidiEffectAudioProcessor::writeParameters(juce::OutputStream& stream)
 {
-    StringArray output;
-    for (int i = -9; i < 10; i++)
+    juce::Array<juce::RangedAudioParameter*> changed;
+
+    // the alterations are saved with the table
+    for (auto* p : getParameters())
+        if (auto* param = dynamic_cast<juce::RangedAudioParameter*>(p))
+            if (param->getValue() != param->getDefaultValue() && !isAlterationParameter(param))
+                changed.add(param);
+
+    stream.writeCompressedInt(changed.size());
+
+    for (auto* param : changed)
     {
-        String* s = new String();
-        if (i > 0)
-            s->append("+", 1);
-        s->append(String(i), 2);
-        output.add(*s);
+        stream.writeString(param->paramID);
+        stream.writeFloat(param->getValue());
     }
-    return output;
 }
 
-juce::StringArray listMIDINotes()
+void MidiEffectAudioProcessor::readParameters(juce::InputStream& stream)
 {
-    std::vector<String> noteNames = {
-        "C", "C#/Db", "D", "D#/Eb", "E", "F", "F#/Gb", "G", "G#/Ab", "A", "A#/Bb", "B"
-    };
+    juce::HashMap<juce::String, float> values;
 
-    StringArray output;
-    for (int i = 0; i < 115; i++) {
-        output.add(noteNames[i % 12] + String(std::floor((i + 12) / 12)));
+    for (int i = stream.readCompressedInt(); i > 0 && !stream.isExhausted(); --i)
+    {
+        const auto id = stream.readString();
+        values.set(id, stream.readFloat());
     }
 
-    return output;
+    // parameters that aren't listed are back to their default, the alterations follow the table
+    for (auto* p : getParameters())
+        if (auto* param = dynamic_cast<juce::RangedAudioParameter*>(p))
+            if (!isAlterationParameter(param))
+                param->setValueNotifyingHost(values.contains(param->paramID) ? values[param->paramID] : param->getDefaultValue());
+}
+
+
+
+// "N" for notes out of the scale, then the alterations in commas: one table for all the parameters
+static const juce::StringArray& getAlterationTexts()
+{
+    static const juce::StringArray texts = [] {
+        StringArray list;
+        list.add("N");
+        for (int i = -9; i < 10; i++)
+            list.add(i > 0 ? "+" + String(i) : String(i));
+        return list;
+    }();
+    return texts;
+}
+
+juce::String MidiEffectAudioProcessor::getAlterationParameterID(int noteNumber)
+{
+    return "Alteration " + String(noteNumber).paddedLeft('0', 3);
 }
 
 AudioProcessorValueTreeState::ParameterLayout MidiEffectAudioProcessor::createParameterLayout()
 {
     AudioProcessorValueTreeState::ParameterLayout layout;
 
-    for (int i = 1; i <= 16; ++i)
+    // pitch bend range of the downstream synth, sent to it as RPN 0
+    StringArray bendRanges;
+    for (auto semitones : PitchBend::ranges)
+        bendRanges.add(String::fromUTF8("\xc2\xb1") + String(semitones) + (semitones == 1 ? " semitone" : " semitones"));
+    layout.add(std::make_unique<AudioParameterChoice>("Bend Range", "Bend Range", bendRanges, PitchBend::defaultRangeIndex));
+
+    // exclusive mode: notes that are not in the scale are dropped
+    layout.add(std::make_unique<AudioParameterBool>("Exclusive", "Exclusive", false));
+
+    // scales with ascending and descending alterations: how far the melody may step back without turning
+    layout.add(std::make_unique<AudioParameterInt>("Direction Hysteresis", "Direction Hysteresis", 0, 12, 0, "st"));
+
+    // one channel per note (MPE, or plain multi-channel) or MTS SysEx instead of monophonic retuning; in OutputMode order
+    layout.add(std::make_unique<AudioParameterChoice>("Output Mode", "Output Mode", StringArray { "Mono", "MPE", "Multi-channel", "MTS" }, 0));
+
+    // mono mode: every input channel retuned on its own, with its own makam (several players, split keyboards)
+    layout.add(std::make_unique<AudioParameterBool>("Independent Channels", "Independent Channels", false));
+
+    // pitch wheel thinning for slow MIDI links: maximum wheel messages per second (0: no limit) and resolution
+    layout.add(std::make_unique<AudioParameterInt>("Wheel Rate", "Wheel Rate", 0, 1000, 0, "/s",
+        [](int value, int) { return value == 0 ? String("Unlimited") : String(value) + "/s"; },
+        [](const String& text) { return text.trim().equalsIgnoreCase("Unlimited") ? 0 : text.getIntValue(); }));
+    layout.add(std::make_unique<AudioParameterChoice>("Wheel Resolution", "Wheel Resolution", StringArray { "14 bit", "12 bit", "10 bit", "8 bit" }, 0));
+
+    // note bends sent this long before their NoteOn, for synths that scoop at the attack; adds as much latency
+    layout.add(std::make_unique<AudioParameterFloat>("Pre-bend", "Pre-bend", NormalisableRange<float>(0.0f, 20.0f, 0.1f), 0.0f, "ms"));
+
+    // mono mode expression: glide between legato notes, vibrato at a rate or synced to the tempo, and the
+    // maximum density of the pitch wheel ramps that play them
+    layout.add(std::make_unique<AudioParameterFloat>("Glide", "Glide", NormalisableRange<float>(0.0f, 500.0f, 1.0f), 0.0f, "ms"));
+    layout.add(std::make_unique<AudioParameterFloat>("Vibrato Depth", "Vibrato Depth", NormalisableRange<float>(0.0f, 100.0f, 1.0f), 0.0f, "cents"));
+    layout.add(std::make_unique<AudioParameterFloat>("Vibrato Rate", "Vibrato Rate", NormalisableRange<float>(0.5f, 12.0f, 0.1f), 5.5f, "Hz"));
+    layout.add(std::make_unique<AudioParameterChoice>("Vibrato Sync", "Vibrato Sync", StringArray { "Off", "1/4", "1/8", "1/8 T", "1/16", "1/16 T", "1/32" }, 0));
+    layout.add(std::make_unique<AudioParameterFloat>("Expression Density", "Expression Density", NormalisableRange<float>(0.1f, 4.0f, 0.1f), 1.0f, "/ms"));
+
+    // notes, bends and makam switches recorded to a file in the Traces folder, to diagnose stuck bends after a show
+    layout.add(std::make_unique<AudioParameterBool>("Trace", "Trace", false));
+
+    // time spent retuning each block, kept in histograms shown by the editor; with Timing Trace every block also goes to a
+    // Chrome trace (.json) in the Traces folder, to line MakaMIDI up with the host and other plugins after a dropout
+    layout.add(std::make_unique<AudioParameterBool>("Block Timing", "Block Timing", false));
+    layout.add(std::make_unique<AudioParameterBool>("Timing Trace", "Timing Trace", false));
+
+    // makam switching: Program Change n and keyswitch note (Keyswitch + n) select the n-th makam of the library
+    layout.add(std::make_unique<AudioParameterBool>("Program Change", "Program Change", true));
+    layout.add(std::make_unique<AudioParameterInt>("Keyswitch", "Keyswitch", -1, 127, -1, String(),
+        [](int value, int) { return value < 0 ? String("Off") : MidiMessage::getMidiNoteName(value, true, true, 4); },
+        [](const String& text) { return text.trim().equalsIgnoreCase("Off") ? -1 : text.getIntValue(); }));
+
+    // one alteration per MIDI note, excludedParameterValue ("N") meaning not in the scale
+    for (int i = 0; i < TuningTable::numNotes; ++i)
     {
-        String ts = String("Toggle ");
-        ts.append(String(i), 2);
-        String ns = String("Note ");
-        ns.append(String(i), 2);
-        String as = String("Alteration ");
-        as.append(String(i), 2);
-        layout.add(std::make_unique<AudioParameterBool>(ts, ts, false));
-        layout.add(std::make_unique<AudioParameterChoice>(ns, ns, listMIDINotes(), 0));
-        layout.add(std::make_unique<AudioParameterChoice>(as, as, listAlterationsInCommas(), 0));
+        layout.add(std::make_unique<AudioParameterInt>(getAlterationParameterID(i),
+            "Alteration " + MidiMessage::getMidiNoteName(i, true, true, 4),
+            excludedParameterValue, 9, excludedParameterValue, String(),
+            [](int value, int) { return getAlterationTexts()[value - excludedParameterValue]; },
+            [](const String& text) {
+                const int index = getAlterationTexts().indexOf(text.trim());
+                return index >= 0 ? index + excludedParameterValue : jlimit(-9, 9, text.getIntValue());
+            }));
     }
 
     return layout;
@@ -15,14 +15,28 @@
 
 // Changed from Projucer to CMake build system
 //#include <juce_audio_processors/juce_audio_processors.h>
+#include "BlockProfiler.h"
+#include "MakamLibrary.h"
 #include "MidiProcessor.h"
+#include "RealtimeSnapshot.h"
+#include "ScaleParser.h"
+#include "TraceBuffer.h"
+#include "TraceWriter.h"
+#include "TuningBank.h"
+#include "TuningPool.h"
+#include "TuningTable.h"
 
+using namespace juce;
 
 //==============================================================================
 
 /**
 */
-class MidiEffectAudioProcessor  : public juce::AudioProcessor
+class MidiEffectAudioProcessor  : public juce::AudioProcessor,
+                                  private juce::ChangeListener,
+                                  private juce::AudioProcessorParameter::Listener,
+                                  private juce::Timer,
+                                  private TuningPool::LinkListener
                             #if JucePlugin_Enable_ARA
                              , public juce::AudioProcessorARAExtension
                             #endif
@@ -33,7 +47,7 @@ public:
     ~MidiEffectAudioProcessor() override;
 
     //==============================================================================
-    void readScale(const juce::File& fileToRead);
+    ScaleParseResult readScale(const juce::File& fileToRead);
     void printAlterations();
     void prepareToPlay (double sampleRate, int samplesPerBlock) override;
     void releaseResources() override;
@@ -67,21 +81,126 @@ public:
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
 
+    // one "Alteration NNN" parameter per MIDI note; the lowest value means the note is not in the scale
+    static constexpr int excludedParameterValue = -10;
+    static juce::String getAlterationParameterID(int noteNumber);
+    static int toParameterValue(int alteration);
+    static int fromParameterValue(int value);
+
     static juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
     juce::AudioProcessorValueTreeState apvts{ *this, nullptr, "Parameters", createParameterLayout() };
 
-    int parseCommas(String commas);
+    // message thread view of the tuning: the table of the active program, or the latest published table
+    std::shared_ptr<const TuningTable> getAlterations() const;
+    void setAlterations(const TuningTable& newAlterations);
+    void setAlteration(int noteNumber, int alteration);
+
+    // switches to the library's prebuilt table: no disk access, no parsing
+    void selectMakam(const MakamEntry& entry);
+    juce::String getMakamName();
+
+    // bank program used by the audio thread, -1 for the editable table
+    int getActiveProgram() const { return currentProgram.load(); }
+
+    // instances in the same link group (1 to TuningPool::numLinkGroups, 0 for none) share their makam
+    void setLinkGroup(int group);
+    int getLinkGroup() const { return linkGroup; }
+
+    // timing histograms of the audio thread, shown by the editor while Block Timing is on (any thread)
+    const BlockProfiler& getProfiler() const { return profiler; }
+    void clearProfiler() { profiler.clear(); }
+
+    juce::SharedResourcePointer<TuningPool> pool;
+    juce::SharedResourcePointer<MakamLibrary> library;
     
     juce::File root, savedFile;
     int pitchWheelValue = 8192;
     int pitchCorrection = 0;
     int activeNoteNumber = -1;
-    bool exclusive = false;
-    bool readingScale = false;
-    juce::Array<int> alterations;
 
 private:
-    MidiProcessor midiProcessor;
+    // built on the message thread, read once per block by the audio thread
+    RealtimeSnapshot<TuningTable> tuning;
+
+    // what the engine did and how long it took, drained to files by the writer's thread
+    TraceBuffer traceBuffer;
+    BlockProfiler profiler;
+    TraceWriter traceWriter { traceBuffer, profiler };
+
+    // name of the library entry in use, empty once the table is edited or loaded from a file
+    juce::String makamName;
+
+    // programs: the valid library entries, switched sample-accurately by the audio thread
+    RealtimeSnapshot<TuningBank> bank;
+    juce::StringArray programNames;
+    juce::CriticalSection programNamesLock;
+
+    static constexpr int noProgramRequest = -2;
+    std::atomic<int> requestedProgram { noProgramRequest };
+    std::atomic<int> currentProgram { -1 };
+    int activeProgram = -1; // audio thread only
+
+    int linkGroup = 0;
+
+    void applyTuning(std::shared_ptr<const TuningTable> table, const juce::String& name);
+    void linkedTuningChanged(const std::shared_ptr<const TuningTable>& table, const std::string& name) override;
+    // alteration parameters: host changes only mark their note, the table is rebuilt for the marked notes
+    std::array<juce::AudioParameterInt*, TuningTable::numNotes> alterationParameters {};
+    int firstAlterationParameterIndex = 0;
+    std::array<std::atomic<std::uint64_t>, 2> dirtyNotes {};
+    int syncedProgram = -1;
+
+    // the audio thread applies the same changes itself, so automation works without the message thread:
+    // its own dirty mask, the raw parameter values and a local copy of the editable table
+    std::array<std::atomic<float>*, TuningTable::numNotes> alterationValues {};
+    std::array<std::atomic<std::uint64_t>, 2> automatedNotes {};
+    std::atomic<std::uint32_t> tuningGeneration { 0 };
+    std::uint32_t automatedGeneration = 0; // audio thread only
+    TuningTable automatedTable;            // audio thread only
+    bool automationActive = false;         // audio thread only
+
+    const TuningTable& applyAutomation(const TuningTable& editableTable, const TuningBank& programs);
+
+    void parameterValueChanged(int parameterIndex, float newValue) override;
+    void parameterGestureChanged(int, bool) override {}
+    void timerCallback() override;
+    void applyParameterChanges();
+    bool readParameterChanges(const std::array<std::uint64_t, 2>& notes, TuningTable& alterations) const;
+    void syncParameters(const TuningTable& table);
+    bool isAlterationParameter(const juce::AudioProcessorParameter* param) const;
+
+    void writeParameters(juce::OutputStream& stream);
+    void readParameters(juce::InputStream& stream);
+
+    void requestProgram(int program);
+    void rebuildBank();
+    void changeListenerCallback(juce::ChangeBroadcaster* source) override;
+
+    std::atomic<float>* bendRangeParameter = nullptr;
+    std::atomic<float>* programChangeParameter = nullptr;
+    std::atomic<float>* keyswitchParameter = nullptr;
+    std::atomic<float>* exclusiveParameter = nullptr;
+    std::atomic<float>* directionHysteresisParameter = nullptr;
+    std::atomic<float>* independentChannelsParameter = nullptr;
+    std::atomic<float>* outputModeParameter = nullptr;
+    std::atomic<float>* wheelRateParameter = nullptr;
+    std::atomic<float>* wheelResolutionParameter = nullptr;
+    std::atomic<float>* preBendParameter = nullptr;
+    std::atomic<float>* glideParameter = nullptr;
+    std::atomic<float>* vibratoDepthParameter = nullptr;
+    std::atomic<float>* vibratoRateParameter = nullptr;
+    std::atomic<float>* vibratoSyncParameter = nullptr;
+    std::atomic<float>* expressionDensityParameter = nullptr;
+    std::atomic<float>* traceParameter = nullptr;
+    std::atomic<float>* blockTimingParameter = nullptr;
+    std::atomic<float>* timingTraceParameter = nullptr;
+
+    int getPreBendSamples() const;
+    void updateLatency();
+    int getVibratoPeriodSamples();
+
+    // the engine works on the host's buffer directly
+    BasicMidiProcessor<juce::MidiBuffer> midiProcessor;
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MidiEffectAudioProcessor)
 };
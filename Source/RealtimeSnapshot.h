@@ -0,0 +1,125 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    RealtimeSnapshot.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*
+    @brief
+    RCU-style holder of an immutable object shared between writers (message thread, host state
+    calls) and a single realtime reader (the audio thread).
+
+    Writers publish a complete new object with one atomic exchange. The reader pins the current
+    object for the duration of a block with acquire()/release(), which never blocks or allocates.
+    Replaced objects are only destroyed by writers, once the reader no longer pins them.
+*/
+template <typename ObjectType>
+class RealtimeSnapshot
+{
+public:
+    explicit RealtimeSnapshot(std::shared_ptr<const ObjectType> initial = std::make_shared<const ObjectType>())
+        : owner(std::move(initial))
+    {
+        current.store(owner.get());
+    }
+
+    //==============================================================================
+    // writer side
+
+    void publish(std::shared_ptr<const ObjectType> next)
+    {
+        const std::lock_guard<std::mutex> lock(writerLock);
+
+        current.exchange(next.get(), std::memory_order_seq_cst);
+        retired.push_back(std::move(owner));
+        owner = std::move(next);
+        collectGarbageLocked();
+    }
+
+    // the most recently published object (not necessarily the one the reader is using right now)
+    std::shared_ptr<const ObjectType> get() const
+    {
+        const std::lock_guard<std::mutex> lock(writerLock);
+        return owner;
+    }
+
+    // frees replaced objects that the reader has let go of
+    void collectGarbage()
+    {
+        const std::lock_guard<std::mutex> lock(writerLock);
+        collectGarbageLocked();
+    }
+
+    //==============================================================================
+    // reader side (one realtime thread)
+
+    const ObjectType* acquire() noexcept
+    {
+        auto* object = current.load(std::memory_order_seq_cst);
+
+        // announce the pin, then make sure it wasn't retired in between
+        for (;;)
+        {
+            inUse.store(object, std::memory_order_seq_cst);
+            auto* check = current.load(std::memory_order_seq_cst);
+
+            if (check == object)
+                return object;
+
+            object = check;
+        }
+    }
+
+    void release() noexcept
+    {
+        inUse.store(nullptr, std::memory_order_release);
+    }
+
+    struct ScopedRead
+    {
+        explicit ScopedRead(RealtimeSnapshot& s) noexcept : snapshot(s), object(s.acquire()) {}
+        ~ScopedRead() noexcept                              { snapshot.release(); }
+
+        const ObjectType& operator*() const noexcept        { return *object; }
+        const ObjectType* operator->() const noexcept       { return object; }
+        const ObjectType* get() const noexcept              { return object; }
+
+        RealtimeSnapshot& snapshot;
+        const ObjectType* object;
+    };
+
+private:
+    void collectGarbageLocked()
+    {
+        auto* pinned = inUse.load(std::memory_order_seq_cst);
+
+        for (auto it = retired.begin(); it != retired.end();)
+        {
+            if (it->get() != pinned)
+                it = retired.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    std::atomic<const ObjectType*> current { nullptr };
+    std::atomic<const ObjectType*> inUse { nullptr };
+
+    mutable std::mutex writerLock;
+    std::shared_ptr<const ObjectType> owner;
+    std::vector<std::shared_ptr<const ObjectType>> retired;
+};
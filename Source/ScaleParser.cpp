@@ -0,0 +1,395 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    ScaleParser.cpp
+
+  ==============================================================================
+*/
+
+#include "ScaleParser.h"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace
+{
+    bool isSpace(char c) noexcept   { return c == ' ' || c == '\t'; }
+    bool isDigit(char c) noexcept   { return c >= '0' && c <= '9'; }
+
+    void trim(const char*& begin, const char*& end) noexcept
+    {
+        while (begin < end && isSpace(*begin))
+            ++begin;
+        while (end > begin && isSpace(end[-1]))
+            --end;
+    }
+
+    // optional sign followed by digits and nothing else
+    bool parseInt(const char* begin, const char* end, int& value) noexcept
+    {
+        trim(begin, end);
+
+        bool negative = false;
+        if (begin < end && (*begin == '-' || *begin == '+'))
+            negative = *begin++ == '-';
+
+        if (begin == end)
+            return false;
+
+        int result = 0;
+        for (; begin < end; ++begin)
+        {
+            if (!isDigit(*begin) || result > 100000)
+                return false;
+            result = result * 10 + (*begin - '0');
+        }
+
+        value = negative ? -result : result;
+        return true;
+    }
+
+    const char* findSeparator(const char* begin, const char* end) noexcept
+    {
+        while (begin < end && *begin != ',' && *begin != ';' && *begin != '\t')
+            ++begin;
+        return begin;
+    }
+
+    // moves to the field after the one ending at end (an empty one past the end of the line)
+    void nextField(const char*& begin, const char*& end, const char* lineEnd) noexcept
+    {
+        begin = end < lineEnd ? end + 1 : lineEnd;
+        end = findSeparator(begin, lineEnd);
+    }
+
+    bool isBlank(const char* begin, const char* end) noexcept
+    {
+        trim(begin, end);
+        return begin == end;
+    }
+
+    std::uint32_t hashAlterations(const std::uint8_t* bytes, std::size_t size) noexcept
+    {
+        std::uint32_t hash = 2166136261u;
+        for (std::size_t i = 0; i < size; ++i)
+            hash = (hash ^ bytes[i]) * 16777619u;
+        return hash;
+    }
+
+    std::uint8_t toByte(int alteration) noexcept { return (std::uint8_t) (alteration == TuningTable::excluded ? -128 : alteration); }
+
+    // "# key: value" with a lowercase key made of letters only
+    void readMetadata(ScaleParseResult& result, const char* begin, const char* end)
+    {
+        ++begin;
+        trim(begin, end);
+
+        const char* keyEnd = begin;
+        while (keyEnd < end && ((*keyEnd >= 'a' && *keyEnd <= 'z') || (*keyEnd >= 'A' && *keyEnd <= 'Z')))
+            ++keyEnd;
+
+        if (keyEnd == begin || keyEnd == end || *keyEnd != ':')
+            return;
+
+        const char* valueStart = keyEnd + 1;
+        trim(valueStart, end);
+
+        std::string key(begin, keyEnd);
+        for (auto& c : key)
+            if (c >= 'A' && c <= 'Z')
+                c = (char) (c - 'A' + 'a');
+
+        result.metadata.emplace_back(std::move(key), std::string(valueStart, end));
+    }
+
+    void addDiagnostic(ScaleParseResult& result, ScaleDiagnostic::Severity severity, int line, std::string message)
+    {
+        result.diagnostics.push_back({ severity, line, std::move(message) });
+    }
+}
+
+//==============================================================================
+bool ScaleParser::parseCommas(const char* begin, const char* end, int& alteration) noexcept
+{
+    trim(begin, end);
+
+    // if the field contains N (NaN, #N/A, N), the note is interpreted as not in the scale
+    if (std::memchr(begin, 'N', (std::size_t) (end - begin)) != nullptr)
+    {
+        alteration = TuningTable::excluded;
+        return true;
+    }
+
+    int commas = 0;
+    if (!parseInt(begin, end, commas) || commas <= -10 || commas >= 10)
+        return false;
+
+    alteration = commas;
+    return true;
+}
+
+ScaleParseResult ScaleParser::parseCsv(const char* data, std::size_t size)
+{
+    ScaleParseResult result;
+
+    const char* p = data;
+    const char* const end = data + size;
+
+    // UTF-8 byte order mark, as written by spreadsheet exports
+    if (size >= 3 && std::memcmp(p, "\xef\xbb\xbf", 3) == 0)
+        p += 3;
+
+    bool seenData = false;
+    bool seenNote[TuningTable::numNotes] = {};
+
+    for (int lineNumber = 1; p < end; ++lineNumber)
+    {
+        const char* lineStart = p;
+        while (p < end && *p != '\n' && *p != '\r')
+            ++p;
+        const char* lineEnd = p;
+
+        // CRLF counts as one line break
+        if (p < end && *p == '\r')
+            ++p;
+        if (p < end && *p == '\n')
+            ++p;
+
+        trim(lineStart, lineEnd);
+
+        if (lineStart < lineEnd && *lineStart == '#')
+        {
+            readMetadata(result, lineStart, lineEnd);
+            continue;
+        }
+
+        if (lineStart == lineEnd || (lineEnd - lineStart >= 2 && lineStart[0] == '/' && lineStart[1] == '/'))
+            continue;
+
+        const char* noteEnd = findSeparator(lineStart, lineEnd);
+        int noteNumber = 0;
+
+        if (!parseInt(lineStart, noteEnd, noteNumber))
+        {
+            // a non-numeric first line is a column header
+            if (!seenData)
+            {
+                seenData = true;
+                continue;
+            }
+
+            addDiagnostic(result, ScaleDiagnostic::Severity::error, lineNumber,
+                          "invalid note number '" + std::string(lineStart, noteEnd) + "'");
+            continue;
+        }
+
+        seenData = true;
+
+        if (noteNumber < 0 || noteNumber >= TuningTable::numNotes)
+        {
+            addDiagnostic(result, ScaleDiagnostic::Severity::error, lineNumber,
+                          "note number " + std::to_string(noteNumber) + " is outside 0-127");
+            continue;
+        }
+
+        if (noteEnd == lineEnd)
+        {
+            addDiagnostic(result, ScaleDiagnostic::Severity::error, lineNumber, "missing alteration");
+            continue;
+        }
+
+        const char* commasStart = noteEnd + 1;
+        const char* commasEnd = findSeparator(commasStart, lineEnd);
+        int alteration = 0;
+
+        if (!parseCommas(commasStart, commasEnd, alteration))
+        {
+            addDiagnostic(result, ScaleDiagnostic::Severity::error, lineNumber,
+                          "invalid alteration '" + std::string(commasStart, commasEnd) + "', expected commas in [-9, 9] or NaN");
+            continue;
+        }
+
+        // name, then the ascending and descending alterations, the plain one where blank
+        const char* fieldStart = commasStart;
+        const char* fieldEnd = commasEnd;
+        nextField(fieldStart, fieldEnd, lineEnd);
+
+        int directional[2] = { alteration, alteration };
+        bool validDirections = true;
+
+        for (int& directionalAlteration : directional)
+        {
+            nextField(fieldStart, fieldEnd, lineEnd);
+
+            if (isBlank(fieldStart, fieldEnd))
+                continue;
+
+            if (!parseCommas(fieldStart, fieldEnd, directionalAlteration) || directionalAlteration == TuningTable::excluded)
+            {
+                addDiagnostic(result, ScaleDiagnostic::Severity::error, lineNumber,
+                              "invalid directional alteration '" + std::string(fieldStart, fieldEnd) + "', expected commas in [-9, 9]");
+                validDirections = false;
+            }
+            else if (alteration == TuningTable::excluded)
+            {
+                addDiagnostic(result, ScaleDiagnostic::Severity::warning, lineNumber,
+                              "note " + std::to_string(noteNumber) + " is not in the scale, its directional alterations are ignored");
+                break;
+            }
+        }
+
+        if (!validDirections)
+            continue;
+
+        if (seenNote[noteNumber])
+            addDiagnostic(result, ScaleDiagnostic::Severity::warning, lineNumber,
+                          "note " + std::to_string(noteNumber) + " is listed twice, the last value is used");
+
+        seenNote[noteNumber] = true;
+        result.table.setDirectional(noteNumber, alteration, directional[TuningTable::ascending], directional[TuningTable::descending]);
+        ++result.numEntries;
+    }
+
+    if (result.numEntries == 0 && !result.hasErrors())
+        addDiagnostic(result, ScaleDiagnostic::Severity::error, 0, "the file contains no notes");
+
+    return result;
+}
+
+ScaleParseResult ScaleParser::parse(const void* data, std::size_t size)
+{
+    if (!CompiledTuning::hasSignature(data, size))
+        return parseCsv(static_cast<const char*>(data), size);
+
+    ScaleParseResult result;
+    std::string error;
+
+    if (CompiledTuning::read(data, size, result.table, error))
+        result.numEntries = TuningTable::numNotes;
+    else
+        addDiagnostic(result, ScaleDiagnostic::Severity::error, 0, error);
+
+    return result;
+}
+
+//==============================================================================
+bool CompiledTuning::hasSignature(const void* data, std::size_t size) noexcept
+{
+    return size >= 4 && std::memcmp(data, "MKTN", 4) == 0;
+}
+
+std::vector<std::uint8_t> CompiledTuning::write(const TuningTable& table)
+{
+    // tables without directions keep the version 1 layout, which older readers load too
+    const bool directional = table.hasDirections();
+    const std::size_t numAlterations = (std::size_t) TuningTable::numNotes * (directional ? 3 : 1);
+    std::vector<std::uint8_t> bytes(fileSize(directional), 0);
+
+    std::memcpy(bytes.data(), "MKTN", 4);
+    bytes[4] = directional ? version : 1;
+    bytes[5] = directional ? directionsFlag : 0;
+    bytes[6] = (std::uint8_t) (TuningTable::numNotes & 0xff);
+    bytes[7] = (std::uint8_t) (TuningTable::numNotes >> 8);
+
+    auto* alterations = bytes.data() + headerSize;
+    for (int i = 0; i < TuningTable::numNotes; ++i)
+    {
+        alterations[i] = toByte(table[i]);
+
+        if (directional)
+        {
+            alterations[TuningTable::numNotes + i] = toByte(table.get(i, TuningTable::ascending));
+            alterations[2 * TuningTable::numNotes + i] = toByte(table.get(i, TuningTable::descending));
+        }
+    }
+
+    const auto hash = hashAlterations(alterations, numAlterations);
+    for (int i = 0; i < 4; ++i)
+        alterations[numAlterations + (std::size_t) i] = (std::uint8_t) (hash >> (8 * i));
+
+    return bytes;
+}
+
+bool CompiledTuning::read(const void* data, std::size_t size, TuningTable& table, std::string& error)
+{
+    auto* bytes = static_cast<const std::uint8_t*>(data);
+
+    if (!hasSignature(data, size) || size < headerSize)
+    {
+        error = "not a compiled tuning";
+        return false;
+    }
+
+    if (bytes[4] == 0 || bytes[4] > version)
+    {
+        error = "unsupported compiled tuning version " + std::to_string(bytes[4]);
+        return false;
+    }
+
+    const bool directional = bytes[4] >= 2 && (bytes[5] & directionsFlag) != 0;
+    const std::size_t numAlterations = (std::size_t) TuningTable::numNotes * (directional ? 3 : 1);
+
+    if ((bytes[6] | (bytes[7] << 8)) != TuningTable::numNotes || size < fileSize(directional))
+    {
+        error = "truncated compiled tuning";
+        return false;
+    }
+
+    const auto* alterations = bytes + headerSize;
+    const auto* stored = alterations + numAlterations;
+    const std::uint32_t hash = (std::uint32_t) stored[0] | ((std::uint32_t) stored[1] << 8)
+                             | ((std::uint32_t) stored[2] << 16) | ((std::uint32_t) stored[3] << 24);
+
+    if (hash != hashAlterations(alterations, numAlterations))
+    {
+        error = "compiled tuning is corrupted (checksum mismatch)";
+        return false;
+    }
+
+    TuningTable loaded;
+    for (int i = 0; i < TuningTable::numNotes; ++i)
+    {
+        int values[3] = {};
+
+        for (std::size_t d = 0; d < 3; ++d)
+            values[d] = (std::int8_t) alterations[directional ? d * TuningTable::numNotes + (std::size_t) i : (std::size_t) i];
+
+        if (values[0] == -128)
+            continue;
+
+        for (int value : values)
+        {
+            if (value <= -10 || value >= 10)
+            {
+                error = "compiled tuning holds an invalid alteration for note " + std::to_string(i);
+                return false;
+            }
+        }
+
+        loaded.setDirectional(i, values[0], values[1], values[2]);
+    }
+
+    table = loaded;
+    return true;
+}
+
+ScaleParseResult ScaleParser::parseFile(const std::string& path)
+{
+    std::ifstream stream(path, std::ios::binary);
+
+    if (!stream)
+    {
+        ScaleParseResult result;
+        addDiagnostic(result, ScaleDiagnostic::Severity::error, 0, "failed to open file");
+        return result;
+    }
+
+    const std::vector<char> contents { std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>() };
+    return parse(contents.data(), contents.size());
+}
@@ -0,0 +1,119 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    ScaleParser.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "TuningTable.h"
+
+/*
+    @brief
+    a problem found while reading a scale: errors reject the scale, warnings don't
+*/
+struct ScaleDiagnostic
+{
+    enum class Severity { warning, error };
+
+    Severity severity;
+    int line;               // 1-based, 0 when the problem isn't tied to a line
+    std::string message;
+};
+
+struct ScaleParseResult
+{
+    TuningTable table;
+    std::vector<ScaleDiagnostic> diagnostics;
+    int numEntries = 0;     // notes read from the file, excluded ones included
+
+    // "# key: value" comment lines, e.g. "# tonic: 79" or "# family: Hicaz"
+    std::vector<std::pair<std::string, std::string>> metadata;
+
+    std::string getMetadata(const std::string& key) const
+    {
+        for (auto& entry : metadata)
+            if (entry.first == key)
+                return entry.second;
+        return {};
+    }
+
+    bool hasErrors() const
+    {
+        for (auto& d : diagnostics)
+            if (d.severity == ScaleDiagnostic::Severity::error)
+                return true;
+        return false;
+    }
+};
+
+namespace ScaleParser
+{
+    /*
+        @brief
+        returns the alteration in commas [-9, 9] written between begin and end, or TuningTable::excluded
+        if the field marks a note that is not in the scale (NaN, #N/A, ...). Returns false if the field is invalid.
+    */
+    bool parseCommas(const char* begin, const char* end, int& alteration) noexcept;
+
+    /*
+        @brief
+        single pass over the bytes of a scale CSV ("note,commas[,name[,ascending,descending]]" per line:
+        the last two are the alterations when the melody moves up or down, empty for the plain one).
+        Accepts LF, CRLF and CR line endings, a UTF-8 BOM, a header line, blank lines,
+        and comments starting with '#' or "//". Never throws.
+    */
+    ScaleParseResult parseCsv(const char* data, std::size_t size);
+
+    // parses either format, telling them apart by the compiled tuning signature
+    ScaleParseResult parse(const void* data, std::size_t size);
+
+    // reads and parses a file of either format (hosts without JUCE; the plugin memory maps the file instead)
+    ScaleParseResult parseFile(const std::string& path);
+}
+
+/*
+    @brief
+    compact binary form of a TuningTable, loaded with a single copy and a checksum.
+
+    Layout (little endian, 140 bytes, 396 with directions):
+        0   "MKTN"
+        4   uint8   format version (1, or 2 for tables with directions)
+        5   uint8   flags: directionsFlag if the ascending and descending alterations follow
+        6   uint16  number of notes (128)
+        8   int8    alteration for each note, -128 when the note is excluded
+      [ 136 int8    ascending alteration for each note
+        264 int8    descending alteration for each note ]
+        136 / 392   uint32  FNV-1a hash of the alterations
+*/
+namespace CompiledTuning
+{
+    constexpr std::uint8_t version = 2;
+    constexpr std::uint8_t directionsFlag = 1;
+    constexpr std::size_t headerSize = 8;
+
+    // bytes of a compiled tuning: the header, one or three alterations per note and the hash
+    constexpr std::size_t fileSize(bool withDirections) noexcept
+    {
+        return headerSize + (std::size_t) TuningTable::numNotes * (withDirections ? 3 : 1) + 4;
+    }
+
+    constexpr const char* fileExtension = ".mkt";
+
+    bool hasSignature(const void* data, std::size_t size) noexcept;
+
+    std::vector<std::uint8_t> write(const TuningTable& table);
+    bool read(const void* data, std::size_t size, TuningTable& table, std::string& error);
+}
@@ -0,0 +1,132 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    TraceBuffer.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+/*
+    @brief
+    what the engine did, in 16 bytes. The meaning of value and extra depends on the type:
+        - noteOn, noteOff: the bend on the channel when the note went out (-1 unknown), the velocity;
+        - bend: the value sent, the value it replaced (-1 unknown);
+        - skippedNote: a note not in the scale dropped in exclusive mode: -1, the velocity;
+        - invalidPitch: the user wheel value that stopped the block, 0;
+        - programSwitch: the program before, 0 (table holds the new one).
+    time is the engine's trace clock: samples, or whatever the host sets with setTraceTime()
+*/
+struct TraceRecord
+{
+    enum Type : std::uint8_t
+    {
+        noteOn,
+        noteOff,
+        bend,
+        skippedNote,
+        invalidPitch,
+        programSwitch
+    };
+
+    std::int64_t time;
+    std::int16_t value;
+    std::int16_t extra;
+    Type type;
+    std::uint8_t channel;   // 1 to 16
+    std::uint8_t note;
+    std::int8_t table;      // program in use, -1 for the editable table
+
+    static const char* getTypeName(Type type) noexcept
+    {
+        static const char* const names[] = { "note-on", "note-off", "bend", "skipped-note", "invalid-pitch", "program" };
+        return type < sizeof(names) / sizeof(names[0]) ? names[type] : "?";
+    }
+
+    // one line of text (consumer side), returns the length written like snprintf
+    int format(char* text, std::size_t size) const noexcept
+    {
+        return std::snprintf(text, size, "%lld %s ch=%d note=%d value=%d extra=%d table=%d\n",
+                             (long long) time, getTypeName(type), channel, note, value, extra, table);
+    }
+};
+
+static_assert(sizeof(TraceRecord) == 16, "trace records are meant to stay small");
+
+/*
+    @brief
+    fixed-size, lock-free single producer / single consumer queue of records (TraceRecords, or the block
+    timings of BlockProfiler). The engine pushes on the audio thread (a copy and two atomics, never blocks
+    or allocates), a background thread drains. When the consumer falls behind, new records are dropped and counted
+*/
+template <typename RecordType>
+class BasicTraceBuffer
+{
+public:
+    // capacity is rounded up to a power of two
+    explicit BasicTraceBuffer(std::size_t capacity = 16384)
+    {
+        std::size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+
+        records.resize(size);
+        mask = size - 1;
+    }
+
+    // producer
+    void push(const RecordType& record) noexcept
+    {
+        const auto write = writeIndex.load(std::memory_order_relaxed);
+
+        if (write - readIndex.load(std::memory_order_acquire) > mask)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        records[write & mask] = record;
+        writeIndex.store(write + 1, std::memory_order_release);
+    }
+
+    // consumer: calls function(record) for every record pushed so far, returns how many
+    template <typename Function>
+    std::size_t drain(Function&& function)
+    {
+        auto read = readIndex.load(std::memory_order_relaxed);
+        const auto write = writeIndex.load(std::memory_order_acquire);
+        const auto count = (std::size_t) (write - read);
+
+        for (; read != write; ++read)
+            function(records[read & mask]);
+
+        readIndex.store(read, std::memory_order_release);
+        return count;
+    }
+
+    // records lost since the last call
+    std::uint64_t takeDropped() noexcept { return dropped.exchange(0, std::memory_order_relaxed); }
+
+private:
+    std::vector<RecordType> records;
+    std::size_t mask = 0;
+
+    // producer and consumer indices on separate cache lines
+    alignas(64) std::atomic<std::uint64_t> writeIndex { 0 };
+    alignas(64) std::atomic<std::uint64_t> readIndex { 0 };
+    std::atomic<std::uint64_t> dropped { 0 };
+};
+
+using TraceBuffer = BasicTraceBuffer<TraceRecord>;
@@ -0,0 +1,178 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    TraceWriter.cpp
+
+  ==============================================================================
+*/
+
+#include "TraceWriter.h"
+
+#include <juce_data_structures/juce_data_structures.h>
+
+//==============================================================================
+TraceWriter::TraceWriter(TraceBuffer& bufferToDrain, BlockProfiler& profilerToDrain)
+    : juce::Thread("MakaMIDI trace"),
+      buffer(bufferToDrain),
+      profiler(profilerToDrain),
+      // one file per instance: start time and a random suffix
+      file(getTraceDirectory().getChildFile("MakaMIDI-" + juce::Time::getCurrentTime().formatted("%Y%m%d-%H%M%S")
+                                            + "-" + juce::String::toHexString(juce::Random::getSystemRandom().nextInt()) + ".log")),
+      timelineFile(file.withFileExtension(".json"))
+{
+    deleteOldTraces();
+    startThread();
+}
+
+TraceWriter::~TraceWriter()
+{
+    stopThread(2000);
+    // what the engine pushed last
+    drain();
+
+    if (stream != nullptr || timelineStream != nullptr)
+    {
+        char text[512];
+        const int prefix = std::snprintf(text, sizeof(text), "# timing: ");
+        const int length = profiler.formatSummary(text + prefix, sizeof(text) - (size_t) prefix);
+
+        if (length > 0)
+            write(text, prefix + length, sizeof(text));
+        if (stream != nullptr)
+            stream->flush();
+    }
+}
+
+juce::File TraceWriter::getTraceDirectory()
+{
+    juce::PropertiesFile::Options options;
+    options.applicationName = "MakaMIDI";
+    options.filenameSuffix = ".settings";
+    options.folderName = "MakaMIDI";
+    options.osxLibrarySubFolder = "Application Support";
+    return options.getDefaultFile().getSiblingFile("Traces");
+}
+
+void TraceWriter::deleteOldTraces()
+{
+    const auto limit = juce::Time::getCurrentTime() - juce::RelativeTime::days(7);
+
+    for (const auto& entry : juce::RangedDirectoryIterator(getTraceDirectory(), false, "MakaMIDI-*.log;MakaMIDI-*.json"))
+        if (entry.getModificationTime() < limit)
+            entry.getFile().deleteFile();
+}
+
+void TraceWriter::run()
+{
+    while (!threadShouldExit())
+    {
+        drain();
+        wait(drainIntervalMs);
+    }
+}
+
+void TraceWriter::drain()
+{
+    char text[128];
+
+    if (const auto dropped = buffer.takeDropped())
+        write(text, std::snprintf(text, sizeof(text), "# %llu records dropped\n", (unsigned long long) dropped), sizeof(text));
+
+    buffer.drain([&](const TraceRecord& record) {
+        write(text, record.format(text, sizeof(text)), sizeof(text));
+    });
+
+    if (stream != nullptr)
+        stream->flush();
+
+    drainTimeline();
+}
+
+void TraceWriter::drainTimeline()
+{
+    char text[1024];
+    const double ticksPerMicrosecond = profiler.getClock().getTicksPerMicrosecond();
+
+    if (const auto dropped = profiler.takeDroppedTimeline())
+        writeTimeline(text, std::snprintf(text, sizeof(text), "{\"name\":\"%llu blocks dropped\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":0,\"tid\":%d},\n",
+                                          (unsigned long long) dropped,
+                                          profiler.getClock().toSteadyMicroseconds(CycleClock::now(), ticksPerMicrosecond), getTrackId()),
+                      sizeof(text));
+
+    profiler.drainTimeline([&](const BlockTiming& timing) {
+        writeTimeline(text, timing.format(text, sizeof(text), profiler.getClock(), ticksPerMicrosecond, 0, getTrackId()), sizeof(text));
+    });
+
+    if (timelineStream != nullptr)
+        timelineStream->flush();
+}
+
+void TraceWriter::write(const char* text, int length, std::size_t size)
+{
+    if (length <= 0)
+        return;
+
+    if (stream != nullptr && stream->getPosition() >= maxFileSize)
+    {
+        stream.reset();
+        file.moveFileTo(file.withFileExtension(".old.log"));
+    }
+
+    if (stream == nullptr)
+    {
+        file.getParentDirectory().createDirectory();
+        stream = std::make_unique<juce::FileOutputStream>(file);
+
+        if (stream->failedToOpen())
+        {
+            stream.reset();
+            return;
+        }
+
+        stream->writeText("# time type channel note value extra table (see TraceBuffer.h)\n", false, false, nullptr);
+    }
+
+    // snprintf's length: what didn't fit in the buffer is lost
+    stream->write(text, (size_t) juce::jmin(length, (int) size - 1));
+}
+
+// one Chrome trace track per instance, named after its log
+int TraceWriter::getTrackId() const
+{
+    return file.hashCode() & 0x7fffffff;
+}
+
+void TraceWriter::writeTimeline(const char* text, int length, std::size_t size)
+{
+    if (length <= 0)
+        return;
+
+    if (timelineStream != nullptr && timelineStream->getPosition() >= maxFileSize)
+    {
+        timelineStream.reset();
+        timelineFile.moveFileTo(timelineFile.withFileExtension(".old.json"));
+    }
+
+    if (timelineStream == nullptr)
+    {
+        timelineFile.getParentDirectory().createDirectory();
+        timelineStream = std::make_unique<juce::FileOutputStream>(timelineFile);
+
+        if (timelineStream->failedToOpen())
+        {
+            timelineStream.reset();
+            return;
+        }
+
+        char start[256];
+        const int startLength = BlockTiming::formatTraceStart(start, sizeof(start), file.getFileNameWithoutExtension().toRawUTF8(), 0, getTrackId());
+        timelineStream->write(start, (size_t) juce::jlimit(0, (int) sizeof(start) - 1, startLength));
+    }
+
+    timelineStream->write(text, (size_t) juce::jmin(length, (int) size - 1));
+}
@@ -0,0 +1,62 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    TraceWriter.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include "BlockProfiler.h"
+#include "TraceBuffer.h"
+
+/*
+    @brief
+    drains an instance's TraceBuffer to a text file in the "Traces" folder next to the settings,
+    on a background thread, so that a stuck bend reported after a show can be traced back.
+
+    The file is only created once there is something to write. Past maxFileSize it is renamed to
+    "<name>.old.log" and a new one starts, so an instance never keeps more than twice that; traces
+    older than a week are deleted when an instance starts.
+
+    The block timings the profiler queues go the same way to "<name>.json", a Chrome trace to open in
+    chrome://tracing or ui.perfetto.dev next to the traces of the host and other plugins; the timing
+    summary ends the log of an instance that wrote one
+*/
+class TraceWriter : private juce::Thread
+{
+public:
+    TraceWriter(TraceBuffer& bufferToDrain, BlockProfiler& profilerToDrain);
+    ~TraceWriter() override;
+
+    juce::File getFile() const { return file; }
+
+    static juce::File getTraceDirectory();
+
+private:
+    static constexpr juce::int64 maxFileSize = 4 * 1024 * 1024;
+    static constexpr int drainIntervalMs = 250;
+
+    TraceBuffer& buffer;
+    BlockProfiler& profiler;
+    const juce::File file, timelineFile;
+    std::unique_ptr<juce::FileOutputStream> stream, timelineStream;
+
+    void run() override;
+    void drain();
+    void drainTimeline();
+    void write(const char* text, int length, std::size_t size);
+    void writeTimeline(const char* text, int length, std::size_t size);
+    int getTrackId() const;
+
+    static void deleteOldTraces();
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TraceWriter)
+};
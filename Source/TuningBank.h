@@ -0,0 +1,51 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    TuningBank.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <array>
+#include <memory>
+#include "TuningTable.h"
+
+/*
+    @brief
+    preloaded tables that Program Change and keyswitch notes select on the audio thread.
+    Built on the message thread and published whole, like TuningTable
+*/
+struct TuningBank
+{
+    static constexpr int maxPrograms = 128;
+
+    void add(std::shared_ptr<const TuningTable> table)
+    {
+        if (numPrograms >= maxPrograms || table == nullptr)
+            return;
+
+        tables[(std::size_t) numPrograms] = table.get();
+        owners[(std::size_t) numPrograms] = std::move(table);
+        ++numPrograms;
+    }
+
+    bool contains(int program) const noexcept               { return program >= 0 && program < numPrograms; }
+    const TuningTable* get(int program) const noexcept      { return tables[(std::size_t) program]; }
+    std::shared_ptr<const TuningTable> getShared(int program) const { return contains(program) ? owners[(std::size_t) program] : nullptr; }
+
+    // the table of program, or editable when program isn't in the bank (-1)
+    const TuningTable& select(const TuningTable& editable, int program) const noexcept { return contains(program) ? *tables[(std::size_t) program] : editable; }
+
+    int numPrograms = 0;
+
+private:
+    std::array<const TuningTable*, maxPrograms> tables {};
+    std::array<std::shared_ptr<const TuningTable>, maxPrograms> owners;
+};
@@ -0,0 +1,150 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    TuningExport.cpp
+
+  ==============================================================================
+*/
+
+#include "TuningExport.h"
+
+#include <cmath>
+#include <cstdio>
+
+namespace
+{
+    constexpr double centsPerComma = 200.0 / 9.0;
+    constexpr double note0Frequency = 8.1757989156437073; // 440 Hz * 2^(-69/12)
+    constexpr int notesPerOctave = 12;
+
+    int getCommas(const TuningTable& table, int noteNumber) noexcept
+    {
+        return table.isExcluded(noteNumber) ? 0 : table[noteNumber];
+    }
+
+    // appends a line of numbers (names are appended as strings, they have no length limit)
+    template <typename... Args>
+    void appendLine(std::string& text, const char* format, Args... args)
+    {
+        char line[64];
+        std::snprintf(line, sizeof(line), format, args...);
+        text += line;
+        text += '\n';
+    }
+
+    // Scala reads a value with a period as cents
+    void appendCents(std::string& text, double cents)
+    {
+        appendLine(text, " %.5f", cents);
+    }
+}
+
+namespace TuningExport
+{
+    double getCents(const TuningTable& table, int noteNumber) noexcept
+    {
+        return 100.0 * noteNumber + getCommas(table, noteNumber) * centsPerComma;
+    }
+
+    bool isOctavePeriodic(const TuningTable& table) noexcept
+    {
+        for (int i = 0; i < TuningTable::numNotes; ++i)
+            for (int j = i + notesPerOctave; j < TuningTable::numNotes; j += notesPerOctave)
+                if (!table.isExcluded(i) && !table.isExcluded(j) && table[i] != table[j])
+                    return false;
+        return true;
+    }
+
+    std::string toScl(const TuningTable& table, const std::string& name)
+    {
+        std::string text;
+        text += "! " + name + ".scl\n!\n";
+        text += name + " (MakaMIDI)\n";
+
+        if (isOctavePeriodic(table))
+        {
+            // the alteration of each pitch class, wherever it is defined
+            int commas[notesPerOctave] = {};
+            for (int i = 0; i < TuningTable::numNotes; ++i)
+                if (!table.isExcluded(i))
+                    commas[i % notesPerOctave] = table[i];
+
+            appendLine(text, " %d", notesPerOctave);
+            text += "!\n";
+            for (int degree = 1; degree < notesPerOctave; ++degree)
+                appendCents(text, 100.0 * degree + (commas[degree] - commas[0]) * centsPerComma);
+            text += " 2/1\n";
+        }
+        else
+        {
+            // one degree per note above note 0, the last one (note 127) closing the "octave"
+            const double base = getCents(table, 0);
+
+            appendLine(text, " %d", TuningTable::numNotes - 1);
+            text += "!\n";
+            for (int note = 1; note < TuningTable::numNotes; ++note)
+                appendCents(text, getCents(table, note) - base);
+        }
+
+        return text;
+    }
+
+    std::string toKbm(const TuningTable& table, const std::string& name)
+    {
+        const bool periodic = isOctavePeriodic(table);
+        // the reference note sounds at its altered pitch
+        const int referenceNote = periodic ? 69 : 0;
+        const double referenceFrequency = note0Frequency * std::pow(2.0, getCents(table, referenceNote) / 1200.0);
+
+        std::string text;
+        text += "! " + name + ".kbm\n";
+        text += "! keyboard mapping of " + name + " (MakaMIDI)\n";
+        text += "! map size\n";
+        appendLine(text, "%d", periodic ? notesPerOctave : 0);
+        text += "! first and last MIDI note\n0\n127\n";
+        text += "! middle note (scale degree 0)\n";
+        appendLine(text, "%d", periodic ? 60 : 0);
+        text += "! reference note and its frequency\n";
+        appendLine(text, "%d", referenceNote);
+        appendLine(text, "%.6f", referenceFrequency);
+        text += "! formal octave degree\n";
+        appendLine(text, "%d", periodic ? notesPerOctave : TuningTable::numNotes - 1);
+
+        if (periodic)
+        {
+            text += "! mapping\n";
+            for (int degree = 0; degree < notesPerOctave; ++degree)
+                appendLine(text, "%d", degree);
+        }
+
+        return text;
+    }
+
+    std::string toTun(const TuningTable& table, const std::string& name)
+    {
+        std::string text;
+        text += "; " + name + " (MakaMIDI)\n";
+        text += "[Scale Begin]\nFormat= \"AnaMark-TUN\"\nFormatVersion= 200\n"
+                "FormatSpecs= \"http://www.mark-henning.de/eternity/tuningspecs.html\"\n\n";
+        text += "[Info]\n";
+        text += "Name= \"" + name + "\"\n";
+        text += "\n[Tuning]\n";
+
+        // rounded to whole cents for readers of the first version of the format
+        for (int note = 0; note < TuningTable::numNotes; ++note)
+            appendLine(text, "note %d= %d", note, (int) std::lround(getCents(table, note)));
+
+        text += "\n[Exact Tuning]\n";
+        appendLine(text, "BaseFreq= %.10f", note0Frequency);
+        for (int note = 0; note < TuningTable::numNotes; ++note)
+            appendLine(text, "note %d= %.6f", note, getCents(table, note));
+
+        text += "\n[Scale End]\n";
+        return text;
+    }
+}
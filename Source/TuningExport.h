@@ -0,0 +1,40 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    TuningExport.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <string>
+#include "TuningTable.h"
+
+/*
+    @brief
+    writes a tuning table in the formats synths with native tuning read: Scala .scl + .kbm and AnaMark .tun.
+    Notes outside the scale keep their equal tempered pitch, as they sound through the plugin outside
+    exclusive mode.
+
+    A table whose alterations repeat every octave becomes a 12-degree .scl starting on C, with the usual
+    keyboard mapping (middle C on degree 0, A 69 tuned to its altered 440 Hz). Any other table gets one
+    degree per MIDI note, mapped linearly from note 0, so the export is exact in both cases.
+*/
+namespace TuningExport
+{
+    // pitch of a note in cents above MIDI note 0 (8.1758 Hz)
+    double getCents(const TuningTable& table, int noteNumber) noexcept;
+
+    // true if every note of the scale has the alteration of the other notes of its pitch class
+    bool isOctavePeriodic(const TuningTable& table) noexcept;
+
+    std::string toScl(const TuningTable& table, const std::string& name);
+    std::string toKbm(const TuningTable& table, const std::string& name);
+    std::string toTun(const TuningTable& table, const std::string& name);
+}
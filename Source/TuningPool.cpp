@@ -0,0 +1,154 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    TuningPool.cpp
+
+  ==============================================================================
+*/
+
+#include "TuningPool.h"
+
+std::uint64_t TuningPool::hash(const TuningTable& table) noexcept
+{
+    // FNV-1a over the alterations, then the directional ones if any (tables without keep their hash)
+    std::uint64_t h = 14695981039346656037ull;
+    const int numValues = TuningTable::numNotes * (table.hasDirections() ? 3 : 1);
+
+    for (int i = 0; i < numValues; ++i)
+    {
+        auto value = (std::uint32_t) (i < TuningTable::numNotes ? table[i]
+                                                                 : table.get(i % TuningTable::numNotes, (TuningTable::Direction) (i / TuningTable::numNotes - 1)));
+
+        for (int b = 0; b < 4; ++b)
+        {
+            h = (h ^ (value & 0xff)) * 1099511628211ull;
+            value >>= 8;
+        }
+    }
+
+    return h;
+}
+
+std::shared_ptr<const TuningTable> TuningPool::intern(const TuningTable& table)
+{
+    const auto key = hash(table);
+    const std::lock_guard<std::mutex> sl(lock);
+
+    auto& candidates = tables[key];
+
+    for (auto& weak : candidates)
+        if (auto existing = weak.lock())
+            if (*existing == table)
+                return existing;
+
+    auto created = std::make_shared<const TuningTable>(table);
+    candidates.push_back(created);
+
+    // every so often, forget the tables nobody uses any more
+    if (++internsSincePrune >= 64)
+        pruneExpired();
+
+    return created;
+}
+
+std::shared_ptr<const TuningTable> TuningPool::find(std::uint64_t contentHash)
+{
+    const std::lock_guard<std::mutex> sl(lock);
+
+    auto it = tables.find(contentHash);
+    if (it == tables.end())
+        return nullptr;
+
+    for (auto& weak : it->second)
+        if (auto existing = weak.lock())
+            return existing;
+
+    return nullptr;
+}
+
+std::size_t TuningPool::size()
+{
+    const std::lock_guard<std::mutex> sl(lock);
+    pruneExpired();
+
+    std::size_t count = 0;
+    for (auto& entry : tables)
+        count += entry.second.size();
+    return count;
+}
+
+void TuningPool::pruneExpired()
+{
+    internsSincePrune = 0;
+
+    for (auto it = tables.begin(); it != tables.end();)
+    {
+        auto& candidates = it->second;
+
+        for (auto weak = candidates.begin(); weak != candidates.end();)
+            weak = weak->expired() ? candidates.erase(weak) : weak + 1;
+
+        it = candidates.empty() ? tables.erase(it) : std::next(it);
+    }
+}
+
+//==============================================================================
+void TuningPool::setLinkGroup(LinkListener* listener, int group)
+{
+    std::shared_ptr<const TuningTable> adopted;
+    std::string adoptedName;
+
+    {
+        const std::lock_guard<std::mutex> sl(lock);
+
+        auto previous = memberships.find(listener);
+        if (previous != memberships.end())
+        {
+            auto& members = groups[previous->second].members;
+            members.erase(std::remove(members.begin(), members.end(), listener), members.end());
+            memberships.erase(previous);
+        }
+
+        if (group < 1 || group > numLinkGroups)
+            return;
+
+        memberships[listener] = group;
+        auto& state = groups[group];
+        state.members.push_back(listener);
+        adopted = state.table;
+        adoptedName = state.makamName;
+    }
+
+    if (adopted != nullptr)
+        listener->linkedTuningChanged(adopted, adoptedName);
+}
+
+void TuningPool::publishToGroup(LinkListener* source, const std::shared_ptr<const TuningTable>& table, const std::string& makamName)
+{
+    std::vector<LinkListener*> others;
+
+    {
+        const std::lock_guard<std::mutex> sl(lock);
+
+        auto membership = memberships.find(source);
+        if (membership == memberships.end())
+            return;
+
+        auto& state = groups[membership->second];
+        state.table = table;
+        state.makamName = makamName;
+
+        for (auto* member : state.members)
+            if (member != source)
+                others.push_back(member);
+    }
+
+    // called without the lock, so that listeners can use the pool
+    for (auto* member : others)
+        member->linkedTuningChanged(table, makamName);
+}
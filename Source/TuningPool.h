@@ -0,0 +1,83 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    TuningPool.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "TuningTable.h"
+
+/*
+    @brief
+    process-wide pool of tuning tables, keyed by a hash of their content.
+
+    Identical tables loaded by any number of plugin instances (or by the library) share one
+    immutable copy, freed when the last user lets go of it. The pool also implements link
+    groups: instances in the same group follow each other's makam.
+
+    Shared between plugin instances through juce::SharedResourcePointer<TuningPool>.
+*/
+class TuningPool
+{
+public:
+    static std::uint64_t hash(const TuningTable& table) noexcept;
+
+    // the pooled table with the same content, created if there is none
+    std::shared_ptr<const TuningTable> intern(const TuningTable& table);
+
+    // the pooled table with this hash, nullptr if no instance uses it any more
+    std::shared_ptr<const TuningTable> find(std::uint64_t contentHash);
+
+    // number of distinct tables alive in the process
+    std::size_t size();
+
+    //==============================================================================
+    // link groups (message thread)
+
+    struct LinkListener
+    {
+        virtual ~LinkListener() = default;
+        virtual void linkedTuningChanged(const std::shared_ptr<const TuningTable>& table, const std::string& makamName) = 0;
+    };
+
+    static constexpr int numLinkGroups = 8;
+
+    // joins a group (1 to numLinkGroups, 0 leaves every group) and adopts its current tuning, if any
+    void setLinkGroup(LinkListener* listener, int group);
+
+    // tells the other members of the listener's group about its new tuning
+    void publishToGroup(LinkListener* source, const std::shared_ptr<const TuningTable>& table, const std::string& makamName);
+
+private:
+    struct GroupState
+    {
+        std::vector<LinkListener*> members;
+        std::shared_ptr<const TuningTable> table;
+        std::string makamName;
+    };
+
+    void pruneExpired();
+
+    std::mutex lock;
+    std::unordered_map<std::uint64_t, std::vector<std::weak_ptr<const TuningTable>>> tables;
+    std::map<int, GroupState> groups;
+    std::map<LinkListener*, int> memberships;
+    std::size_t internsSincePrune = 0;
+};
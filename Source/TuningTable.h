@@ -0,0 +1,72 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    TuningTable.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <limits>
+
+/*
+    @brief
+    alteration in commas for every MIDI note. Published tables are never modified:
+    the message thread builds a new one and swaps it in (see RealtimeSnapshot).
+
+    Makams may raise a note when the melody ascends and lower it when it descends: each note also has an
+    alteration for either direction, equal to the plain one unless the scale says otherwise, so the engine
+    always pays a single lookup. Whether a note is in the scale doesn't depend on the direction
+*/
+struct TuningTable
+{
+    static constexpr int numNotes = 128;
+
+    // +inf means the note is not part of the scale
+    static constexpr int excluded = std::numeric_limits<int>::max();
+
+    enum Direction
+    {
+        ascending,
+        descending
+    };
+
+    TuningTable() noexcept
+    {
+        alterations.fill(excluded);
+        for (auto& directional : directionalAlterations)
+            directional.fill(excluded);
+    }
+
+    int operator[](int noteNumber) const noexcept           { return alterations[(std::size_t) noteNumber]; }
+    int get(int noteNumber, Direction direction) const noexcept { return directionalAlterations[(std::size_t) direction][(std::size_t) noteNumber]; }
+    bool isExcluded(int noteNumber) const noexcept          { return alterations[(std::size_t) noteNumber] == excluded; }
+
+    // the same alteration in both directions
+    void set(int noteNumber, int alteration) noexcept       { setDirectional(noteNumber, alteration, alteration, alteration); }
+
+    void setDirectional(int noteNumber, int alteration, int ascendingAlteration, int descendingAlteration) noexcept
+    {
+        const bool isExcludedNote = alteration == excluded;
+        alterations[(std::size_t) noteNumber] = alteration;
+        directionalAlterations[ascending][(std::size_t) noteNumber] = isExcludedNote ? excluded : ascendingAlteration;
+        directionalAlterations[descending][(std::size_t) noteNumber] = isExcludedNote ? excluded : descendingAlteration;
+    }
+
+    // true if some note has an alteration of its own in either direction
+    bool hasDirections() const noexcept { return directionalAlterations[ascending] != alterations || directionalAlterations[descending] != alterations; }
+
+    bool operator==(const TuningTable& other) const noexcept { return alterations == other.alterations && directionalAlterations == other.directionalAlterations; }
+    bool operator!=(const TuningTable& other) const noexcept { return !(*this == other); }
+
+    std::array<int, numNotes> alterations;
+    std::array<std::array<int, numNotes>, 2> directionalAlterations;
+};
@@ -0,0 +1,148 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    UniversalMidiPacket.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/*
+    @brief
+    the MIDI 2.0 channel voice messages the engine emits in OutputMode::midi2, as 64-bit Universal
+    MIDI Packets (message type 4, group 0). A packet is two 32-bit words in native byte order, the
+    way UMP travels through memory; in a MidiEventBuffer each packet is one 8-byte event.
+
+    Pitch is absolute: the note number plus the alteration, in the Pitch 7.25 format (7 bits of
+    semitone, 25 bits of fraction). It goes out as the Pitch 7.9 attribute of Note On and as
+    Registered Per-Note Controller 3 when a sounding note is retuned, so no pitch bend is needed.
+*/
+namespace Ump
+{
+    constexpr int numWords = 2;
+    constexpr int numBytes = numWords * (int) sizeof(std::uint32_t);
+
+    using Packet = std::array<std::uint32_t, numWords>;
+
+    // Pitch 7.25 of one semitone, and the largest pitch the format holds (just below note 128)
+    constexpr std::uint32_t semitone = 1u << 25;
+    constexpr std::uint32_t maxPitch = (128u << 25) - 1;
+
+    /*
+        @brief
+        Pitch 7.25 offset of every alteration in [-commasPerTone, commasPerTone], computed at compile time
+        like the pitch wheel tables (a tone is two semitones)
+    */
+    template <int commasPerTone = 9>
+    struct PitchTable
+    {
+        static constexpr int maxCommas = commasPerTone;
+        static constexpr int size = 2 * commasPerTone + 1;
+
+        static constexpr std::array<std::int32_t, size> build()
+        {
+            std::array<std::int32_t, size> offsets {};
+
+            for (int commas = -commasPerTone; commas <= commasPerTone; ++commas)
+            {
+                const long long numerator = (long long) commas * 2 * semitone;
+                // round half away from zero
+                offsets[(std::size_t) (commas + commasPerTone)] =
+                    (std::int32_t) ((numerator + (numerator < 0 ? -commasPerTone : commasPerTone) / 2) / commasPerTone);
+            }
+
+            return offsets;
+        }
+
+        static constexpr std::array<std::int32_t, size> offsets = build();
+    };
+
+    // Pitch 7.25 of noteNumber altered by commas (notes outside the scale are played with 0)
+    inline std::uint32_t pitch(int noteNumber, int commas) noexcept
+    {
+        const long long value = (long long) noteNumber * semitone + PitchTable<>::offsets[(std::size_t) (commas + PitchTable<>::maxCommas)];
+        return value < 0 ? 0u : (value > (long long) maxPitch ? maxPitch : (std::uint32_t) value);
+    }
+
+    // MIDI 1.0 to MIDI 2.0 value scaling: the centre stays the centre, the maximum becomes the maximum
+    constexpr std::uint32_t upscale(std::uint32_t value, int sourceBits, int destinationBits) noexcept
+    {
+        const int scaleBits = destinationBits - sourceBits;
+        const std::uint32_t centre = 1u << (sourceBits - 1);
+        const std::uint32_t shifted = value << scaleBits;
+
+        if (value <= centre)
+            return shifted;
+
+        // repeat the bits below the top one to fill the lower part
+        const int repeatBits = sourceBits - 1;
+        const std::uint32_t repeatValue = value & ((1u << repeatBits) - 1);
+        std::uint32_t result = shifted;
+        std::uint32_t repeat = scaleBits > repeatBits ? repeatValue << (scaleBits - repeatBits) : repeatValue >> (repeatBits - scaleBits);
+
+        while (repeat != 0)
+        {
+            result |= repeat;
+            repeat >>= repeatBits;
+        }
+
+        return result;
+    }
+
+    constexpr std::uint32_t header(int status, int channel, int byte3, int byte4) noexcept
+    {
+        return (0x4u << 28) | ((std::uint32_t) (status | (channel & 0x0f)) << 16)
+             | ((std::uint32_t) (byte3 & 0x7f) << 8) | (std::uint32_t) (byte4 & 0xff);
+    }
+
+    constexpr int pitchAttribute = 0x03; // Pitch 7.9
+    constexpr int pitchPerNoteController = 3; // Registered Per-Note Controller: Pitch 7.25
+
+    // channel is 0 to 15, velocity 1 to 127
+    inline Packet noteOn(int channel, int noteNumber, int velocity, std::uint32_t notePitch) noexcept
+    {
+        // Pitch 7.9, rounded from 7.25
+        const std::uint32_t pitch79 = std::min<std::uint32_t>((notePitch + (1u << 15)) >> 16, 0xffff);
+        return { header(0x90, channel, noteNumber, pitchAttribute), (upscale((std::uint32_t) velocity, 7, 16) << 16) | pitch79 };
+    }
+
+    inline Packet noteOff(int channel, int noteNumber, int velocity) noexcept
+    {
+        return { header(0x80, channel, noteNumber, 0), upscale((std::uint32_t) velocity, 7, 16) << 16 };
+    }
+
+    inline Packet perNotePitch(int channel, int noteNumber, std::uint32_t notePitch) noexcept
+    {
+        return { header(0x00, channel, noteNumber, pitchPerNoteController), notePitch };
+    }
+
+    // 14-bit pitch wheel value, centre 8192
+    inline Packet pitchBend(int channel, int value) noexcept
+    {
+        return { header(0xe0, channel, 0, 0), upscale((std::uint32_t) value, 14, 32) };
+    }
+
+    // a MIDI 1.0 channel voice message (up to 3 bytes) as a 32-bit MIDI 1.0 packet (message type 2)
+    inline std::uint32_t midi1ChannelVoice(const std::uint8_t* data, int numBytes) noexcept
+    {
+        return (0x2u << 28) | ((std::uint32_t) data[0] << 16)
+             | (numBytes > 1 ? (std::uint32_t) (data[1] & 0x7f) << 8 : 0u)
+             | (numBytes > 2 ? (std::uint32_t) (data[2] & 0x7f) : 0u);
+    }
+
+    inline Packet registeredController(int channel, int bank, int index, std::uint32_t value) noexcept
+    {
+        return { header(0x20, channel, bank, index & 0x7f), value };
+    }
+}
@@ -0,0 +1,196 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    VoiceAllocator.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+/*
+    @brief
+    gives each sounding note an output channel of its own, so that its pitch bend only moves that note.
+    Fixed capacity, no allocation, every operation O(1):
+        - free voices are kept in release order, and a note takes the one released longest ago
+          (its release tail has had the most time to fade);
+        - sounding voices are kept in start order, and when none is free the oldest note is stolen;
+        - (input channel, note) -> voice is a direct lookup table.
+    Round robin instead walks the channels in order, for multitimbral synths that expect it.
+*/
+class VoiceAllocator
+{
+public:
+    static constexpr int maxVoices = 16;
+    static constexpr int none = -1;
+
+    enum class Policy
+    {
+        leastRecentlyReleased,
+        roundRobin
+    };
+
+    struct Voice
+    {
+        int channel = 1;        // output channel, 1 to 16
+        int inputChannel = none;
+        int note = none;
+        int bend = -1;          // last pitch wheel value sent on the channel, -1 if unknown
+
+        bool isActive() const noexcept { return note != none; }
+    };
+
+    VoiceAllocator() { reset(Policy::leastRecentlyReleased, 2, 15); }
+
+    // voices on channels firstChannel .. firstChannel + numVoices - 1, all free
+    void reset(Policy newPolicy, int firstChannel, int numVoicesToUse) noexcept
+    {
+        policy = newPolicy;
+        numVoices = numVoicesToUse < 1 ? 1 : (numVoicesToUse > maxVoices ? maxVoices : numVoicesToUse);
+        cursor = 0;
+        free = {};
+        active = {};
+
+        for (auto& channelNotes : lookup)
+            channelNotes.fill((std::int8_t) none);
+
+        for (int v = 0; v < numVoices; ++v)
+        {
+            voices[(std::size_t) v] = Voice();
+            voices[(std::size_t) v].channel = firstChannel + v;
+            append(free, v);
+        }
+    }
+
+    int getNumVoices() const noexcept                   { return numVoices; }
+    Voice& operator[](int voice) noexcept               { return voices[(std::size_t) voice]; }
+    const Voice& operator[](int voice) const noexcept   { return voices[(std::size_t) voice]; }
+
+    // the voice playing note from inputChannel (0 to 15), or none
+    int find(int inputChannel, int note) const noexcept
+    {
+        return lookup[(std::size_t) (inputChannel & 0x0f)][(std::size_t) (note & 0x7f)];
+    }
+
+    /*
+        @brief
+        assigns a voice to a new note. If a sounding voice had to be taken, stolen receives what it
+        was playing (its note is none otherwise) so that the caller can end that note first
+    */
+    int noteOn(int inputChannel, int note, Voice& stolen) noexcept
+    {
+        stolen = Voice();
+        int v;
+
+        if (policy == Policy::roundRobin)
+        {
+            v = cursor;
+            cursor = (cursor + 1) % numVoices;
+        }
+        else
+        {
+            v = free.head != none ? free.head : active.head;
+        }
+
+        auto& voice = voices[(std::size_t) v];
+
+        if (voice.isActive())
+        {
+            stolen = voice;
+            release(v);
+        }
+
+        // v is free by now, whichever way it was chosen
+        unlink(free, v);
+        append(active, v);
+
+        voice.inputChannel = inputChannel & 0x0f;
+        voice.note = note & 0x7f;
+        lookup[(std::size_t) voice.inputChannel][(std::size_t) voice.note] = (std::int8_t) v;
+        return v;
+    }
+
+    void release(int v) noexcept
+    {
+        auto& voice = voices[(std::size_t) v];
+        if (!voice.isActive())
+            return;
+
+        lookup[(std::size_t) voice.inputChannel][(std::size_t) voice.note] = (std::int8_t) none;
+        voice.inputChannel = none;
+        voice.note = none;
+
+        unlink(active, v);
+        append(free, v);
+    }
+
+    // calls function(voiceIndex, voice) for the sounding voices, oldest first
+    template <typename Function>
+    void forEachActive(Function&& function)
+    {
+        for (int v = active.head; v != none; )
+        {
+            const int next = links[(std::size_t) v].next;
+            function(v, voices[(std::size_t) v]);
+            v = next;
+        }
+    }
+
+private:
+    struct List
+    {
+        int head = none, tail = none;
+    };
+
+    struct Link
+    {
+        int previous = none, next = none;
+    };
+
+    Policy policy = Policy::leastRecentlyReleased;
+    int numVoices = 0;
+    int cursor = 0;
+
+    std::array<Voice, maxVoices> voices {};
+    std::array<Link, maxVoices> links {};
+    List free, active; // every voice is in exactly one of them
+    std::array<std::array<std::int8_t, 128>, 16> lookup {};
+
+    void append(List& list, int v) noexcept
+    {
+        links[(std::size_t) v] = { list.tail, none };
+
+        if (list.tail != none)
+            links[(std::size_t) list.tail].next = v;
+        else
+            list.head = v;
+
+        list.tail = v;
+    }
+
+    // v must be in list
+    void unlink(List& list, int v) noexcept
+    {
+        auto& link = links[(std::size_t) v];
+
+        if (link.previous != none)
+            links[(std::size_t) link.previous].next = link.next;
+        else
+            list.head = link.next;
+
+        if (link.next != none)
+            links[(std::size_t) link.next].previous = link.previous;
+        else
+            list.tail = link.previous;
+
+        link = {};
+    }
+};
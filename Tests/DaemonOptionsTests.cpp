@@ -0,0 +1,85 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    DaemonOptionsTests.cpp
+
+    The command line of MakaMIDI_Daemon: every option with its value, and what it refuses
+
+  ==============================================================================
+*/
+
+#include <vector>
+#include "DaemonOptions.h"
+#include "TestRunner.h"
+
+namespace
+{
+    bool parse(std::vector<const char*> arguments, DaemonOptions::Options& options)
+    {
+        arguments.insert(arguments.begin(), "MakaMIDI_Daemon");
+        return DaemonOptions::parse((int) arguments.size(), arguments.data(), options);
+    }
+
+    bool parse(std::vector<const char*> arguments)
+    {
+        DaemonOptions::Options options;
+        return parse(std::move(arguments), options);
+    }
+}
+
+//==============================================================================
+TEST_CASE(daemonOptionsReadEveryOption)
+{
+    DaemonOptions::Options options;
+
+    CHECK(parse({ "--scale", "Rast.csv", "--scales", "makams", "--bend-range", "12", "--keyswitch", "24", "--exclusive",
+                  "--mode", "multi", "--channel-program", "3=2", "--priority", "80", "--report", "0",
+                  "--trace", "trace.txt", "--timing", "--timing-trace", "timeline.json" }, options));
+
+    CHECK_EQUAL(options.scale, std::string("Rast.csv"));
+    CHECK_EQUAL(options.scales, std::string("makams"));
+    CHECK_EQUAL(PitchBend::ranges[(std::size_t) options.bendRangeIndex], 12);
+    CHECK_EQUAL(options.keyswitch, 24);
+    CHECK(options.exclusive);
+    CHECK(options.mode == OutputMode::multiChannel);
+    CHECK(options.independentChannels);
+    CHECK(options.channelPrograms == (std::vector<std::pair<int, int>> { { 3, 2 } }));
+    CHECK_EQUAL(options.priority, 80);
+    CHECK_EQUAL(options.reportSeconds, 1);
+    CHECK_EQUAL(options.trace, std::string("trace.txt"));
+    CHECK(options.timing);
+    CHECK_EQUAL(options.timingTrace, std::string("timeline.json"));
+}
+
+TEST_CASE(daemonOptionsReadEveryOutputMode)
+{
+    const std::pair<const char*, OutputMode> modes[] = { { "mono", OutputMode::mono }, { "mpe", OutputMode::mpe },
+                                                         { "multi", OutputMode::multiChannel } };
+
+    for (auto& [name, mode] : modes)
+    {
+        DaemonOptions::Options options;
+        CHECK(parse({ "--mode", name }, options));
+        CHECK(options.mode == mode);
+    }
+}
+
+TEST_CASE(daemonOptionsRefuseInvalidArguments)
+{
+    DaemonOptions::Options defaults;
+    CHECK(parse({}, defaults));
+    CHECK(defaults.mode == OutputMode::mono);
+    CHECK_EQUAL(defaults.bendRangeIndex, PitchBend::defaultRangeIndex);
+
+    CHECK(!parse({ "--mode", "poly" }));
+    CHECK(!parse({ "--mode" }));
+    CHECK(!parse({ "--bend-range", "5" }));
+    CHECK(!parse({ "--channel-program", "17=1" }));
+    CHECK(!parse({ "--channel-program", "3" }));
+    CHECK(!parse({ "--unknown" }));
+}
@@ -0,0 +1,83 @@
+#!/bin/bash
+#
+#   MakaMIDI
+#   Copyright (c) 2025 Mattia Vassena
+#   Licensed under the MIT License.
+#   See LICENSE file in the project root for full license information.
+#
+#   DaemonSmokeTest.sh
+#
+#   Runs MakaMIDI_Daemon on the ALSA sequencer: aplaymidi plays two notes into "in", aseqdump
+#   listens on "out", and the daemon's latency report has to count the events it retuned.
+#       DaemonSmokeTest.sh <MakaMIDI_Daemon> <aplaymidi> <aseqdump>
+#   Exits with 77 (skipped) where there is no sequencer, as in most containers.
+
+set -u
+
+daemon=$1
+aplaymidi=$2
+aseqdump=$3
+
+if [ ! -e /dev/snd/seq ]; then
+    echo "no ALSA sequencer (/dev/snd/seq): skipped"
+    exit 77
+fi
+
+work=$(mktemp -d)
+daemonPid=
+dumpPid=
+
+cleanup()
+{
+    [ -n "$dumpPid" ] && kill "$dumpPid" 2>/dev/null
+    [ -n "$daemonPid" ] && kill "$daemonPid" 2>/dev/null
+    rm -rf "$work"
+}
+trap cleanup EXIT
+
+fail()
+{
+    echo "FAIL: $1"
+    echo "--- daemon"; cat "$work/daemon.log"
+    echo "--- out"; cat "$work/out.log" 2>/dev/null
+    exit 1
+}
+
+# 61 is 4 commas flat, so its note on needs a bend
+printf '60,0\n61,-4\n62,0\n' > "$work/scale.csv"
+
+# one track, 96 ticks per quarter: note 61 then note 62, each a quarter long
+printf 'MThd\0\0\0\6\0\0\0\1\0\140' > "$work/notes.mid"
+printf 'MTrk\0\0\0\24\0\220\75\144\140\200\75\0\0\220\76\144\140\200\76\0\0\377\57\0' >> "$work/notes.mid"
+
+"$daemon" --scale "$work/scale.csv" --report 1 > "$work/daemon.log" 2>&1 &
+daemonPid=$!
+
+# the daemon prints its client and ports once they exist
+for _ in $(seq 50); do
+    grep -q "ALSA client" "$work/daemon.log" && break
+    kill -0 "$daemonPid" 2>/dev/null || fail "the daemon exited"
+    sleep 0.1
+done
+
+ports=$(sed -n 's/^MakaMIDI: ALSA client \([0-9]*\), ports in \([0-9]*\), control [0-9]*, out \([0-9]*\)$/\1 \2 \3/p' "$work/daemon.log")
+[ -n "$ports" ] || fail "no sequencer ports"
+read -r client inPort outPort <<< "$ports"
+
+"$aseqdump" -p "$client:$outPort" > "$work/out.log" 2>&1 &
+dumpPid=$!
+sleep 0.5
+
+"$aplaymidi" -p "$client:$inPort" "$work/notes.mid" || fail "aplaymidi could not play into the daemon"
+sleep 2
+
+kill -TERM "$daemonPid"
+wait "$daemonPid" || fail "the daemon did not stop cleanly"
+daemonPid=
+
+grep -q "Note on .* note 61" "$work/out.log" || fail "note 61 did not come out"
+grep -q "Pitch bend" "$work/out.log" || fail "note 61 was not retuned"
+grep -Eq "latency: [1-9][0-9]* events" "$work/daemon.log" || fail "no latency report"
+
+grep "latency:" "$work/daemon.log" | tail -n 1
+exit 0
@@ -0,0 +1,142 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    DelayQueueTests.cpp
+
+    DelayQueue: records that end the ring exactly, skipped ends with and without
+    room for the wrap marker, and a long run against a plain FIFO
+
+  ==============================================================================
+*/
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "DelayQueue.h"
+#include "TestRunner.h"
+
+namespace
+{
+    // records are a 10-byte header and the message
+    constexpr std::size_t recordSize = 13;
+
+    bool push(DelayQueue& queue, long long time, std::uint8_t tag, int numBytes = 3)
+    {
+        // the tag comes first, so that every size keeps it
+        const std::uint8_t message[] = { tag, 60, 100 };
+        return queue.push(time, message, numBytes);
+    }
+
+    // the front record's time and tag, then pops it
+    bool popMatches(DelayQueue& queue, long long time, std::uint8_t tag)
+    {
+        if (queue.isEmpty())
+            return false;
+
+        const bool matches = queue.frontTime() == time && queue.front().data[0] == tag;
+        queue.pop();
+        return matches;
+    }
+}
+
+//==============================================================================
+TEST_CASE(delayQueueWrapsAfterARecordThatEndsTheRing)
+{
+    DelayQueue queue;
+    queue.reserve(2 * recordSize);
+
+    CHECK(push(queue, 1, 1));
+    CHECK(push(queue, 2, 2));
+    CHECK(!push(queue, 3, 3));
+
+    // the ring is full to its last byte: the next record goes to the beginning, not past the end
+    CHECK(popMatches(queue, 1, 1));
+    CHECK(push(queue, 3, 3));
+    CHECK(!push(queue, 4, 4));
+
+    CHECK(popMatches(queue, 2, 2));
+    CHECK(popMatches(queue, 3, 3));
+    CHECK(queue.isEmpty());
+}
+
+TEST_CASE(delayQueueSkipsTheEndOfTheRing)
+{
+    // 5 bytes left at the end: room for the wrap marker, not for a record
+    DelayQueue marked;
+    marked.reserve(2 * recordSize + 5);
+
+    CHECK(push(marked, 1, 1));
+    CHECK(push(marked, 2, 2));
+    CHECK(popMatches(marked, 1, 1));
+    CHECK(push(marked, 3, 3));
+    CHECK(!push(marked, 4, 4));
+    CHECK(popMatches(marked, 2, 2));
+    CHECK(popMatches(marked, 3, 3));
+    CHECK(marked.isEmpty());
+
+    // 1 byte left: not even room for the marker
+    DelayQueue unmarked;
+    unmarked.reserve(2 * recordSize + 1);
+
+    CHECK(push(unmarked, 1, 1));
+    CHECK(push(unmarked, 2, 2));
+    CHECK(popMatches(unmarked, 1, 1));
+    CHECK(push(unmarked, 3, 3));
+    CHECK(popMatches(unmarked, 2, 2));
+    CHECK(popMatches(unmarked, 3, 3));
+    CHECK(unmarked.isEmpty());
+}
+
+TEST_CASE(delayQueueRefusesWhatDoesNotFit)
+{
+    DelayQueue queue;
+    CHECK(!push(queue, 1, 1));
+
+    queue.reserve(recordSize - 1);
+    CHECK(!push(queue, 1, 1));
+    CHECK(push(queue, 1, 1, 2));
+    CHECK(!push(queue, 2, 2, 0));
+    CHECK(popMatches(queue, 1, 1));
+    CHECK(queue.isEmpty());
+}
+
+TEST_CASE(delayQueueKeepsOrderOverManyWraps)
+{
+    // message sizes of 1 to 3 bytes against a ring that is no multiple of any record size
+    DelayQueue queue;
+    queue.reserve(97);
+
+    struct Expected { long long time; std::uint8_t tag; };
+    std::deque<Expected> model;
+    long long time = 0;
+    bool ordered = true;
+
+    for (int i = 0; i < 20000; ++i)
+    {
+        const int numBytes = 1 + i % 3;
+        const bool pushing = (i * 7919) % 5 < 3;
+
+        if (pushing)
+        {
+            const auto tag = (std::uint8_t) (i & 0x7f);
+            if (push(queue, ++time, tag, numBytes))
+                model.push_back({ time, tag });
+            else
+                CHECK(!model.empty());
+        }
+        else if (!model.empty())
+        {
+            ordered = ordered && popMatches(queue, model.front().time, model.front().tag);
+            model.pop_front();
+        }
+
+        CHECK_EQUAL(queue.isEmpty(), model.empty());
+    }
+
+    CHECK(ordered);
+}
@@ -0,0 +1,418 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    EngineTests.cpp
+
+    MidiProcessor: restore bends, wheel thinning, pre-bend, melody direction,
+    voice stealing, and no heap allocation in process()
+
+  ==============================================================================
+*/
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <vector>
+#include "AllocationGuard.h"
+#include "MidiProcessor.h"
+#include "TestRunner.h"
+
+namespace
+{
+    // a channel message of the engine's input or output, status byte with its channel
+    struct Message
+    {
+        int samplePosition;
+        int status;
+        int data1;
+        int data2;
+
+        bool operator==(const Message& other) const
+        {
+            return samplePosition == other.samplePosition && status == other.status && data1 == other.data1 && data2 == other.data2;
+        }
+    };
+
+    std::ostream& operator<<(std::ostream& stream, const Message& m)
+    {
+        return stream << std::hex << m.status << std::dec << " " << m.data1 << " " << m.data2 << " @" << m.samplePosition;
+    }
+
+    std::ostream& operator<<(std::ostream& stream, const std::vector<Message>& messages)
+    {
+        stream << "{ ";
+        for (auto& m : messages)
+            stream << "[" << m << "] ";
+        return stream << "}";
+    }
+
+    Message noteOn(int note, int samplePos, int channel = 1)   { return { samplePos, 0x90 | (channel - 1), note, 100 }; }
+    Message noteOff(int note, int samplePos, int channel = 1)  { return { samplePos, 0x80 | (channel - 1), note, 0 }; }
+    Message wheel(int value, int samplePos, int channel = 1)   { return { samplePos, 0xe0 | (channel - 1), value & 0x7f, (value >> 7) & 0x7f }; }
+
+    // the correction of an alteration with the default bend range
+    int correction(int commas) { return PitchBend::getCorrections(PitchBend::defaultRangeIndex)[commas]; }
+
+    int bend(int commas) { return PitchBend::centre + correction(commas); }
+
+    // every note in the scale and unaltered, but 61 (-4 commas) and 66 (+3)
+    TuningTable makeTable()
+    {
+        TuningTable table;
+        for (int i = 0; i < TuningTable::numNotes; ++i)
+            table.set(i, 0);
+
+        table.set(61, -4);
+        table.set(66, 3);
+        return table;
+    }
+
+    int find(const std::vector<Message>& messages, const Message& message)
+    {
+        for (std::size_t i = 0; i < messages.size(); ++i)
+            if (messages[i] == message)
+                return (int) i;
+        return -1;
+    }
+
+    // the engine with the state its host keeps for it, fed one block at a time
+    struct Engine
+    {
+        explicit Engine(const TuningTable& tuning, int blockSize = 512) : table(tuning)
+        {
+            processor.prepare(blockSize);
+            buffer.ensureSize(processor.getOutputCapacity());
+        }
+
+        std::vector<Message> process(const std::vector<Message>& input, int numSamples = 0)
+        {
+            buffer.clear();
+
+            for (auto& m : input)
+            {
+                const std::uint8_t bytes[] = { (std::uint8_t) m.status, (std::uint8_t) m.data1, (std::uint8_t) m.data2 };
+                const int type = m.status & 0xf0;
+                buffer.addEvent(bytes, type == 0xc0 || type == 0xd0 ? 2 : 3, m.samplePosition);
+            }
+
+            processor.process(buffer, &pitchWheel, &pitchCorrection, table, bank, &program, &note, numSamples);
+
+            std::vector<Message> output;
+            for (const auto event : buffer)
+                output.push_back({ event.samplePosition, event.data[0], event.numBytes > 1 ? event.data[1] : 0, event.numBytes > 2 ? event.data[2] : 0 });
+            return output;
+        }
+
+        MidiProcessor processor;
+        TuningTable table;
+        TuningBank bank;
+        MidiEventBuffer buffer;
+        int pitchWheel = PitchBend::centre, pitchCorrection = 0, program = -1, note = -1;
+    };
+}
+
+//==============================================================================
+TEST_CASE(restoreBendIsReplacedByTheNextNotesBend)
+{
+    Engine engine(makeTable());
+    CHECK_EQUAL(engine.process({ noteOn(61, 0) }), (std::vector<Message> { wheel(bend(-4), 0), noteOn(61, 0) }));
+
+    // 61 ends where 66 starts: one bend, straight to 66's pitch
+    CHECK_EQUAL(engine.process({ noteOff(61, 10), noteOn(66, 10) }),
+                (std::vector<Message> { noteOff(61, 10), wheel(bend(3), 10), noteOn(66, 10) }));
+}
+
+TEST_CASE(restoreBendGoesOutBeforeAnUnalteredNote)
+{
+    Engine engine(makeTable());
+    engine.process({ noteOn(61, 0) });
+
+    CHECK_EQUAL(engine.process({ noteOff(61, 10), noteOn(60, 10) }),
+                (std::vector<Message> { noteOff(61, 10), wheel(PitchBend::centre, 10), noteOn(60, 10) }));
+}
+
+TEST_CASE(restoreBendOfTheLastNoteGoesOutAtTheEndOfTheBlock)
+{
+    Engine engine(makeTable());
+
+    CHECK_EQUAL(engine.process({ noteOn(61, 0), noteOff(61, 20) }),
+                (std::vector<Message> { wheel(bend(-4), 0), noteOn(61, 0), noteOff(61, 20), wheel(PitchBend::centre, 20) }));
+    CHECK_EQUAL(engine.pitchCorrection, 0);
+}
+
+//==============================================================================
+TEST_CASE(wheelThinningDropsValuesSupersededWithinTheInterval)
+{
+    Engine engine(makeTable());
+    engine.processor.setWheelThinning(100, 1);
+
+    CHECK_EQUAL(engine.process({ wheel(9000, 0), wheel(9100, 10), wheel(9200, 20), wheel(9300, 150) }, 512),
+                (std::vector<Message> { wheel(9000, 0), wheel(9300, 150) }));
+}
+
+TEST_CASE(wheelThinningSendsTheLastHeldValue)
+{
+    Engine atEnd(makeTable());
+    atEnd.processor.setWheelThinning(100, 1);
+
+    // at the end of the block, where it was played
+    CHECK_EQUAL(atEnd.process({ wheel(9000, 0), wheel(9100, 10) }, 512),
+                (std::vector<Message> { wheel(9000, 0), wheel(9100, 10) }));
+
+    Engine beforeNote(makeTable());
+    beforeNote.processor.setWheelThinning(100, 1);
+
+    // before the next message of its channel
+    CHECK_EQUAL(beforeNote.process({ wheel(9000, 0), wheel(9100, 10), noteOn(60, 20) }, 512),
+                (std::vector<Message> { wheel(9000, 0), wheel(9100, 20), noteOn(60, 20) }));
+}
+
+TEST_CASE(wheelThinningIntervalSpansBlocks)
+{
+    Engine engine(makeTable());
+    engine.processor.setWheelThinning(100, 1);
+    engine.process({ wheel(9000, 500) }, 512);
+
+    // 22 samples after the last wheel message: held, then superseded by a due one
+    CHECK_EQUAL(engine.process({ wheel(9100, 10), wheel(9200, 200) }, 512), (std::vector<Message> { wheel(9200, 200) }));
+
+    // without the block length the window restarts every block
+    Engine unknownLength(makeTable());
+    unknownLength.processor.setWheelThinning(100, 1);
+    unknownLength.process({ wheel(9000, 500) });
+
+    CHECK_EQUAL(unknownLength.process({ wheel(9100, 10), wheel(9200, 200) }), (std::vector<Message> { wheel(9100, 10), wheel(9200, 200) }));
+}
+
+TEST_CASE(noteBendsAreNeverThinned)
+{
+    Engine engine(makeTable());
+    engine.processor.setWheelThinning(1000, 1);
+
+    CHECK_EQUAL(engine.process({ wheel(9000, 0), noteOn(61, 5) }, 512),
+                (std::vector<Message> { wheel(9000, 0), wheel(9000 + correction(-4), 5), noteOn(61, 5) }));
+}
+
+//==============================================================================
+TEST_CASE(preBendSendsNoteBendsAheadAcrossBlocks)
+{
+    Engine engine(makeTable(), 128);
+    engine.processor.setPreBend(64);
+
+    // the bend keeps its time, the NoteOn is due in the next block
+    CHECK_EQUAL(engine.process({ noteOn(61, 100) }, 128), (std::vector<Message> { wheel(bend(-4), 100) }));
+    CHECK_EQUAL(engine.processor.getLatencySamples(), 64);
+
+    // 100 + 64 - 128 = 36; the NoteOff and its restore bend are delayed like any other message
+    CHECK_EQUAL(engine.process({ noteOff(61, 50) }, 128),
+                (std::vector<Message> { noteOn(61, 36), noteOff(61, 114), wheel(PitchBend::centre, 114) }));
+
+    CHECK(engine.process({}, 128).empty());
+}
+
+TEST_CASE(preBendOfANoteStartingAtABlockBoundary)
+{
+    Engine engine(makeTable(), 128);
+    engine.processor.setPreBend(64);
+    engine.process({}, 128);
+
+    CHECK_EQUAL(engine.process({ noteOn(66, 0) }, 128), (std::vector<Message> { wheel(bend(3), 0), noteOn(66, 64) }));
+}
+
+//==============================================================================
+TEST_CASE(directionHysteresisKeepsSmallStepsBack)
+{
+    TuningTable table = makeTable();
+    table.setDirectional(62, 0, 2, -2);
+    table.setDirectional(64, 0, 1, -1);
+
+    Engine engine(table);
+    engine.processor.setDirectionHysteresis(2);
+
+    // note and its alteration in the direction the melody should be found in
+    const int melody[][2] = {
+        { 60, 0 }, { 65, 0 },
+        { 64, 1 },              // 1 semitone below 65: still ascending
+        { 62, -2 },             // 3 below: descending
+        { 64, -1 },             // 2 above 62: still descending
+        { 65, 0 }, { 64, 1 }    // turned up at 65, then 1 below
+    };
+
+    for (auto& step : melody)
+    {
+        engine.process({ noteOn(step[0], 0) });
+        CHECK_EQUAL(engine.pitchCorrection, correction(step[1]));
+    }
+}
+
+TEST_CASE(anyStepBackTurnsTheDirectionWithoutHysteresis)
+{
+    TuningTable table = makeTable();
+    table.setDirectional(64, 0, 1, -1);
+
+    Engine engine(table);
+
+    engine.process({ noteOn(60, 0) });
+    engine.process({ noteOn(65, 0) });
+    engine.process({ noteOn(64, 0) });
+    CHECK_EQUAL(engine.pitchCorrection, correction(-1));
+
+    engine.process({ noteOn(63, 0) });
+    engine.process({ noteOn(64, 0) });
+    CHECK_EQUAL(engine.pitchCorrection, correction(1));
+}
+
+//==============================================================================
+TEST_CASE(mpeStealsTheOldestVoice)
+{
+    Engine engine(makeTable());
+    engine.processor.setOutputMode(OutputMode::mpe);
+
+    std::vector<Message> chord;
+    for (int i = 0; i < 16; ++i)
+        chord.push_back(noteOn(40 + i, i));
+
+    const auto output = engine.process(chord);
+
+    // 15 member channels, from 2
+    for (int i = 0; i < 15; ++i)
+        CHECK(find(output, noteOn(40 + i, i, 2 + i)) >= 0);
+
+    const int stolen = find(output, noteOff(40, 15, 2));
+    CHECK(stolen >= 0);
+    CHECK(find(output, noteOn(55, 15, 2)) > stolen);
+
+    // the stolen note's release has nothing left to end; the next note takes the voice freed last
+    CHECK_EQUAL(engine.process({ noteOff(40, 0), noteOff(41, 1), noteOn(70, 2) }),
+                (std::vector<Message> { noteOff(41, 1, 3), noteOn(70, 2, 3) }));
+}
+
+TEST_CASE(multiChannelStealsInTurn)
+{
+    Engine engine(makeTable());
+    engine.processor.setOutputMode(OutputMode::multiChannel);
+
+    std::vector<Message> chord;
+    for (int i = 0; i < 17; ++i)
+        chord.push_back(noteOn(40 + i, i));
+
+    const auto output = engine.process(chord);
+
+    for (int i = 0; i < 16; ++i)
+        CHECK(find(output, noteOn(40 + i, i, 1 + i)) >= 0);
+
+    const int stolen = find(output, noteOff(40, 16, 1));
+    CHECK(stolen >= 0);
+    CHECK(find(output, noteOn(56, 16, 1)) > stolen);
+}
+
+TEST_CASE(multiChannelForwardsToTheVoicesOfTheirChannel)
+{
+    Engine engine(makeTable());
+    engine.processor.setOutputMode(OutputMode::multiChannel);
+    engine.process({});
+
+    const Message sustainOn { 0, 0xb0, 64, 127 };
+    const Message programChange { 0, 0xc1, 5, 0 };
+
+    // nothing plays yet: the pedal waits for a note of its channel, which takes it first
+    CHECK_EQUAL(engine.process({ sustainOn, noteOn(60, 1) }),
+                (std::vector<Message> { { 1, 0xb0, 64, 127 }, wheel(bend(0), 1), noteOn(60, 1) }));
+
+    // input channel 2 plays on the next voice, without the pedal of channel 1
+    CHECK_EQUAL(engine.process({ programChange, noteOn(62, 1, 2) }),
+                (std::vector<Message> { { 1, 0xc1, 5, 0 }, wheel(bend(0), 1, 2), noteOn(62, 1, 2) }));
+
+    CHECK_EQUAL(engine.process({ { 0, 0xb0, 64, 0 }, { 0, 0xd1, 40, 0 } }),
+                (std::vector<Message> { { 0, 0xb0, 64, 0 }, { 0, 0xd1, 40, 0 } }));
+}
+
+//==============================================================================
+namespace
+{
+    // a bit of everything: notes every 16 samples, wheel every 4, a controller and a makam switch now and then
+    void fillBlock(MidiEventBuffer& buffer, int blockIndex, int blockSize)
+    {
+        for (int i = 0; i < blockSize; i += 4)
+        {
+            const int step = (blockIndex * blockSize + i) / 4;
+            const int note = 48 + step % 24;
+
+            if (i % 16 == 0)
+            {
+                const std::uint8_t off[] = { 0x80, (std::uint8_t) (note - 3), 0 };
+                const std::uint8_t on[] = { (std::uint8_t) (0x90 | (step % 3)), (std::uint8_t) note, 90 };
+                buffer.addEvent(off, 3, i);
+                buffer.addEvent(on, 3, i);
+            }
+
+            const int value = 8192 + (step * 97) % 2000 - 1000;
+            const std::uint8_t bend[] = { 0xe0, (std::uint8_t) (value & 0x7f), (std::uint8_t) (value >> 7) };
+            buffer.addEvent(bend, 3, i);
+        }
+
+        const std::uint8_t sustain[] = { 0xb0, 64, (std::uint8_t) (blockIndex % 2 == 0 ? 127 : 0) };
+        const std::uint8_t programChange[] = { 0xc0, (std::uint8_t) (blockIndex % 2) };
+        buffer.addEvent(sustain, 3, blockSize / 2);
+        buffer.addEvent(programChange, 2, blockSize - 1);
+    }
+}
+
+TEST_CASE(processNeverAllocates)
+{
+   #if MAKAMIDI_TRACK_ALLOCATIONS
+    constexpr int blockSize = 256;
+    constexpr int numBlocks = 200;
+    const OutputMode modes[] = { OutputMode::mono, OutputMode::mpe, OutputMode::multiChannel, OutputMode::mts, OutputMode::midi2 };
+
+    for (auto mode : modes)
+    {
+        const TuningTable table = makeTable();
+        TuningBank bank;
+        bank.add(std::make_shared<const TuningTable>(table));
+        bank.add(std::make_shared<const TuningTable>());
+
+        // small enough to fill up: dropping records must not allocate either
+        TraceBuffer trace(256);
+        BlockProfiler profiler(64);
+        profiler.setTimeline(true);
+
+        MidiProcessor processor;
+        processor.prepare(blockSize);
+        processor.setOutputMode(mode);
+        processor.setTrace(&trace);
+        processor.setProfiler(&profiler);
+        processor.setWheelThinning(48, 4);
+        processor.setPreBend(32);
+        processor.setExpression(480, 20, 9600, 48);
+
+        MidiEventBuffer buffer;
+        buffer.ensureSize(processor.getOutputCapacity());
+        int pitchWheel = PitchBend::centre, pitchCorrection = 0, program = -1, note = -1;
+        unsigned long long allocations = 0;
+
+        for (int b = 0; b < numBlocks; ++b)
+        {
+            // the second half of the mono run on independent channels
+            if (b == numBlocks / 2 && mode == OutputMode::mono)
+                processor.setIndependentChannels(true);
+
+            buffer.clear();
+            fillBlock(buffer, b, blockSize);
+
+            const auto before = AllocationGuard::allocationCount();
+            processor.process(buffer, &pitchWheel, &pitchCorrection, table, bank, &program, &note, blockSize);
+            allocations += AllocationGuard::allocationCount() - before;
+        }
+
+        CHECK_EQUAL(allocations, 0ull);
+    }
+   #else
+    TestRunner::fail(__FILE__, __LINE__, "built without MAKAMIDI_TRACK_ALLOCATIONS");
+   #endif
+}
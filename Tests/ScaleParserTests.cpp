@@ -0,0 +1,168 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    ScaleParserTests.cpp
+
+    ScaleParser and CompiledTuning: what they accept, and how they report what they don't
+
+  ==============================================================================
+*/
+
+#include <cstring>
+#include <string>
+#include "ScaleParser.h"
+#include "TestRunner.h"
+
+namespace
+{
+    ScaleParseResult parse(const std::string& text) { return ScaleParser::parseCsv(text.data(), text.size()); }
+
+    int countDiagnostics(const ScaleParseResult& result, ScaleDiagnostic::Severity severity)
+    {
+        int n = 0;
+        for (auto& d : result.diagnostics)
+            n += d.severity == severity ? 1 : 0;
+        return n;
+    }
+
+    // true if the result holds exactly one diagnostic, of that severity, on that line, and mentioning text
+    bool reportsOnly(const ScaleParseResult& result, ScaleDiagnostic::Severity severity, int line, const char* text)
+    {
+        return result.diagnostics.size() == 1 && result.diagnostics[0].severity == severity
+            && result.diagnostics[0].line == line && result.diagnostics[0].message.find(text) != std::string::npos;
+    }
+
+    constexpr auto error = ScaleDiagnostic::Severity::error;
+    constexpr auto warning = ScaleDiagnostic::Severity::warning;
+}
+
+//==============================================================================
+TEST_CASE(scaleParserReadsHeaderCommentsAndLineEndings)
+{
+    const auto result = parse("\xef\xbb\xbfnote,commas,name\r\n# tonic: 67\r\n// Rast\n60,0,C\r62,-1\n\n64,NaN\n");
+
+    CHECK(result.diagnostics.empty());
+    CHECK_EQUAL(result.numEntries, 3);
+    CHECK_EQUAL(result.table[60], 0);
+    CHECK_EQUAL(result.table[62], -1);
+    CHECK(result.table.isExcluded(64));
+    CHECK(result.table.isExcluded(61));
+    CHECK_EQUAL(result.getMetadata("tonic"), std::string("67"));
+}
+
+TEST_CASE(scaleParserRejectsInvalidNoteNumbers)
+{
+    // the first non-numeric line is a header, later ones are errors
+    CHECK(reportsOnly(parse("note,commas\n60,0\nsol,1\n"), error, 3, "invalid note number 'sol'"));
+    CHECK(reportsOnly(parse("60,0\n128,1\n"), error, 2, "outside 0-127"));
+    CHECK(reportsOnly(parse("60,0\n-1,1\n"), error, 2, "outside 0-127"));
+}
+
+TEST_CASE(scaleParserRejectsInvalidAlterations)
+{
+    CHECK(reportsOnly(parse("60,0\n62\n"), error, 2, "missing alteration"));
+    CHECK(reportsOnly(parse("60,0\n62,10\n"), error, 2, "invalid alteration '10'"));
+    CHECK(reportsOnly(parse("60,0\n62,-10\n"), error, 2, "invalid alteration '-10'"));
+    CHECK(reportsOnly(parse("60,0\n62,one\n"), error, 2, "invalid alteration 'one'"));
+
+    // a rejected line leaves the note out of the table
+    const auto result = parse("60,0\n62,12\n");
+    CHECK(result.hasErrors());
+    CHECK(result.table.isExcluded(62));
+    CHECK_EQUAL(result.numEntries, 1);
+}
+
+TEST_CASE(scaleParserChecksDirectionalAlterations)
+{
+    const auto valid = parse("62,0,D,1,-1\n64,-1,E,,-2\n");
+    CHECK(valid.diagnostics.empty());
+    CHECK_EQUAL(valid.table.get(62, TuningTable::ascending), 1);
+    CHECK_EQUAL(valid.table.get(62, TuningTable::descending), -1);
+    CHECK_EQUAL(valid.table.get(64, TuningTable::ascending), -1);
+    CHECK_EQUAL(valid.table.get(64, TuningTable::descending), -2);
+
+    CHECK(reportsOnly(parse("60,0\n62,0,D,12,-1\n"), error, 2, "invalid directional alteration '12'"));
+    CHECK(reportsOnly(parse("60,0\n62,0,D,1,NaN\n"), error, 2, "invalid directional alteration 'NaN'"));
+
+    const auto excluded = parse("60,0\n62,NaN,D,1,-1\n");
+    CHECK(reportsOnly(excluded, warning, 2, "directional alterations are ignored"));
+    CHECK(excluded.table.isExcluded(62));
+}
+
+TEST_CASE(scaleParserWarnsAboutDuplicatesAndRejectsEmptyFiles)
+{
+    const auto duplicate = parse("60,0\n60,-2\n");
+    CHECK(reportsOnly(duplicate, warning, 2, "listed twice"));
+    CHECK(!duplicate.hasErrors());
+    CHECK_EQUAL(duplicate.table[60], -2);
+
+    CHECK(reportsOnly(parse(""), error, 0, "no notes"));
+    CHECK(reportsOnly(parse("note,commas\n# only comments\n"), error, 0, "no notes"));
+
+    // every line rejected: the errors are enough
+    const auto invalid = parse("60,x\n61,y\n");
+    CHECK_EQUAL(countDiagnostics(invalid, error), 2);
+}
+
+TEST_CASE(scaleParserReportsMissingFiles)
+{
+    CHECK(reportsOnly(ScaleParser::parseFile("no such directory/no such scale.csv"), error, 0, "failed to open file"));
+}
+
+//==============================================================================
+TEST_CASE(compiledTuningRoundTrips)
+{
+    TuningTable table;
+    table.set(60, 0);
+    table.set(61, -4);
+    table.setDirectional(62, 1, 2, -1);
+
+    const auto bytes = CompiledTuning::write(table);
+    const auto result = ScaleParser::parse(bytes.data(), bytes.size());
+
+    CHECK_EQUAL(bytes.size(), CompiledTuning::fileSize(true));
+    CHECK(result.diagnostics.empty());
+    CHECK(result.table == table);
+
+    // without directions the file keeps the version 1 layout
+    TuningTable plain;
+    plain.set(60, 0);
+    CHECK_EQUAL(CompiledTuning::write(plain).size(), CompiledTuning::fileSize(false));
+}
+
+TEST_CASE(compiledTuningRejectsDamagedFiles)
+{
+    TuningTable table;
+    table.set(60, 0);
+    const auto bytes = CompiledTuning::write(table);
+    TuningTable loaded;
+    std::string error;
+
+    auto truncated = bytes;
+    truncated.resize(bytes.size() - 1);
+    CHECK(!CompiledTuning::read(truncated.data(), truncated.size(), loaded, error));
+    CHECK_EQUAL(error, std::string("truncated compiled tuning"));
+
+    auto corrupted = bytes;
+    corrupted[CompiledTuning::headerSize + 60] = 3;
+    CHECK(!CompiledTuning::read(corrupted.data(), corrupted.size(), loaded, error));
+    CHECK(error.find("checksum mismatch") != std::string::npos);
+
+    auto newer = bytes;
+    newer[4] = CompiledTuning::version + 1;
+    CHECK(!CompiledTuning::read(newer.data(), newer.size(), loaded, error));
+    CHECK(error.find("unsupported compiled tuning version") != std::string::npos);
+
+    const char notATuning[] = "60,0\n";
+    CHECK(!CompiledTuning::read(notATuning, std::strlen(notATuning), loaded, error));
+    CHECK_EQUAL(error, std::string("not a compiled tuning"));
+
+    // a failed read leaves the table alone, and parse() reports the error
+    CHECK(loaded == TuningTable());
+    CHECK(reportsOnly(ScaleParser::parse(corrupted.data(), corrupted.size()), ScaleDiagnostic::Severity::error, 0, "checksum mismatch"));
+}
@@ -0,0 +1,45 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    TestMain.cpp
+
+    Runs the tests of makamidi_core:
+        MakaMIDI_Tests [name ...]
+
+    Without arguments every test runs; otherwise only those whose name contains one of
+    the arguments. The exit status is 1 if any check failed.
+
+  ==============================================================================
+*/
+
+#include <cstring>
+#include "TestRunner.h"
+
+int main(int argc, char* argv[])
+{
+    int numRun = 0;
+
+    for (auto& test : TestRunner::getTests())
+    {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc && !selected; ++i)
+            selected = std::strstr(test.name, argv[i]) != nullptr;
+
+        if (!selected)
+            continue;
+
+        const int failuresBefore = TestRunner::failureCount();
+        test.run();
+        ++numRun;
+
+        std::cout << (TestRunner::failureCount() == failuresBefore ? "pass  " : "FAIL  ") << test.name << "\n";
+    }
+
+    std::cout << numRun << " tests, " << TestRunner::failureCount() << " failed checks\n";
+    return TestRunner::failureCount() == 0 && numRun > 0 ? 0 : 1;
+}
@@ -0,0 +1,75 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    TestRunner.h
+
+    Just enough of a test framework for makamidi_core: TEST_CASE registers a test,
+    CHECK and CHECK_EQUAL report a failure and let the test carry on.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+
+namespace TestRunner
+{
+    struct TestCase
+    {
+        const char* name;
+        void (*run)();
+    };
+
+    inline std::vector<TestCase>& getTests()
+    {
+        static std::vector<TestCase> tests;
+        return tests;
+    }
+
+    inline int& failureCount()
+    {
+        static int failures = 0;
+        return failures;
+    }
+
+    struct Registration
+    {
+        Registration(const char* name, void (*run)()) { getTests().push_back({ name, run }); }
+    };
+
+    inline void fail(const char* file, int line, const char* expression)
+    {
+        std::cerr << file << ":" << line << ": check failed: " << expression << "\n";
+        ++failureCount();
+    }
+
+    template <typename Actual, typename Expected>
+    void failEqual(const char* file, int line, const char* expression, const Actual& actual, const Expected& expected)
+    {
+        std::cerr << file << ":" << line << ": check failed: " << expression << " (got " << actual << ", expected " << expected << ")\n";
+        ++failureCount();
+    }
+}
+
+#define TEST_CASE(name) \
+    static void name(); \
+    static const TestRunner::Registration name##Registration(#name, name); \
+    static void name()
+
+#define CHECK(condition) \
+    do { if (!(condition)) TestRunner::fail(__FILE__, __LINE__, #condition); } while (false)
+
+#define CHECK_EQUAL(actual, expected) \
+    do { \
+        const auto& actualValue = (actual); \
+        const auto& expectedValue = (expected); \
+        if (!(actualValue == expectedValue)) \
+            TestRunner::failEqual(__FILE__, __LINE__, #actual " == " #expected, actualValue, expectedValue); \
+    } while (false)
@@ -0,0 +1,342 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    Benchmark.cpp
+
+    Times MidiProcessor::process over synthetic MIDI streams:
+        MakaMIDI_Benchmark [--json | --csv] [--blocks n]
+
+    Every scenario runs at the usual host buffer sizes. Results are per block:
+    mean, p50, p99, p99.9 and max time, time per input event and heap allocations.
+    The exit status is 1 if any block allocated.
+
+  ==============================================================================
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+#include "AllocationGuard.h"
+#include "MidiProcessor.h"
+
+namespace
+{
+    constexpr int blockSizes[] = { 64, 128, 256, 512, 1024 };
+    constexpr int worstCaseBlockSize = 8192;
+    constexpr int warmUpBlocks = 64;
+
+    // fills one block with input events; blockIndex lets the stream carry on across blocks
+    using Generator = std::function<void(MidiEventBuffer&, int blockIndex, int blockSize)>;
+
+    struct Scenario
+    {
+        const char* name;
+        Generator generate;
+        bool worstCaseOnly;
+    };
+
+    struct Result
+    {
+        std::string scenario;
+        int blockSize = 0;
+        double eventsPerBlock = 0;
+        double nsPerEvent = 0;
+        double meanNs = 0, p50Ns = 0, p99Ns = 0, p999Ns = 0, maxNs = 0;
+        double allocationsPerBlock = -1; // unknown unless the allocator is tracked
+    };
+
+    void addNote(MidiEventBuffer& buffer, bool on, int note, int samplePos)
+    {
+        const std::uint8_t message[] = { (std::uint8_t) (on ? 0x90 : 0x80), (std::uint8_t) note, (std::uint8_t) (on ? 100 : 0) };
+        buffer.addEvent(message, 3, samplePos);
+    }
+
+    void addPitchWheel(MidiEventBuffer& buffer, int value, int samplePos)
+    {
+        const std::uint8_t message[] = { 0xe0, (std::uint8_t) (value & 0x7f), (std::uint8_t) ((value >> 7) & 0x7f) };
+        buffer.addEvent(message, 3, samplePos);
+    }
+
+    // a note every 6000 samples (8 per second at 48 kHz), walking up and down two octaves
+    void sparseMelody(MidiEventBuffer& buffer, int blockIndex, int blockSize)
+    {
+        constexpr int spacing = 6000;
+        const long long start = (long long) blockIndex * blockSize;
+
+        for (long long t = (start + spacing - 1) / spacing * spacing; t < start + blockSize; t += spacing)
+        {
+            const int step = (int) (t / spacing);
+            const int note = 48 + std::abs(step % 48 - 24);
+            addNote(buffer, false, 48 + std::abs((step - 1) % 48 - 24), (int) (t - start));
+            addNote(buffer, true, note, (int) (t - start));
+        }
+    }
+
+    // two neighbouring notes alternating every 32 samples, legato
+    void denseTrill(MidiEventBuffer& buffer, int blockIndex, int blockSize)
+    {
+        constexpr int spacing = 32;
+        const long long start = (long long) blockIndex * blockSize;
+
+        for (long long t = (start + spacing - 1) / spacing * spacing; t < start + blockSize; t += spacing)
+        {
+            const bool upper = ((t / spacing) & 1) != 0;
+            addNote(buffer, true, upper ? 63 : 62, (int) (t - start));
+            addNote(buffer, false, upper ? 62 : 63, (int) (t - start));
+        }
+    }
+
+    // one pitch wheel message per sample over a held note, as a sweeping controller would send
+    void pitchWheelFlood(MidiEventBuffer& buffer, int blockIndex, int blockSize)
+    {
+        const long long start = (long long) blockIndex * blockSize;
+
+        if (blockIndex == 0)
+            addNote(buffer, true, 64, 0);
+
+        for (int i = blockIndex == 0 ? 1 : 0; i < blockSize; ++i)
+            addPitchWheel(buffer, (int) ((start + i) * 7 % 16384), i);
+    }
+
+    // one event per sample, cycling through the message types that produce the most output
+    void worstCase(MidiEventBuffer& buffer, int blockIndex, int blockSize)
+    {
+        for (int i = 0; i < blockSize; ++i)
+        {
+            const int note = 36 + (blockIndex * 7 + i) % 60;
+
+            switch (i % 3)
+            {
+                case 0:  addNote(buffer, true, note, i); break;
+                case 1:  addPitchWheel(buffer, (i * 37) % 16384, i); break;
+                default: addNote(buffer, false, note - 1, i); break;
+            }
+        }
+    }
+
+    // alterations in every octave, a few notes out of the scale
+    TuningTable makeTable()
+    {
+        static const int pattern[] = { 0, -4, 1, -1, -2, 0, 4, 0, -4, 1, -1, TuningTable::excluded };
+        TuningTable table;
+
+        for (int i = 0; i < TuningTable::numNotes; ++i)
+            table.set(i, pattern[i % 12]);
+
+        return table;
+    }
+
+    double percentile(const std::vector<double>& sorted, double fraction)
+    {
+        const auto index = (std::size_t) (fraction * (double) (sorted.size() - 1) + 0.5);
+        return sorted[std::min(index, sorted.size() - 1)];
+    }
+
+    Result run(const Scenario& scenario, int blockSize, int numBlocks)
+    {
+        const TuningTable table = makeTable();
+        const TuningBank bank;
+
+        MidiProcessor processor;
+        processor.prepare(blockSize);
+
+        // the streams are generated up front, copying a block into the working buffer is not timed
+        std::vector<MidiEventBuffer> input((std::size_t) numBlocks);
+        long long numEvents = 0;
+
+        for (int b = 0; b < numBlocks; ++b)
+        {
+            scenario.generate(input[(std::size_t) b], b, blockSize);
+            numEvents += input[(std::size_t) b].getNumEvents();
+        }
+
+        // the output comes back in the working buffer: give it the room the engine asks for
+        MidiEventBuffer working;
+        working.ensureSize(processor.getOutputCapacity());
+        int pitchWheelValue = 8192, pitchCorrection = 0, activeProgram = -1, activeNoteNumber = -1;
+
+        // warm up: the buffers reach their working size and the code and data are in cache
+        for (int b = 0; b < std::min(numBlocks, warmUpBlocks); ++b)
+        {
+            working = input[(std::size_t) b];
+            processor.process(working, &pitchWheelValue, &pitchCorrection, table, bank, &activeProgram, &activeNoteNumber);
+        }
+
+        pitchWheelValue = 8192;
+        pitchCorrection = 0;
+        activeNoteNumber = -1;
+
+        std::vector<double> times;
+        times.reserve((std::size_t) numBlocks);
+        unsigned long long allocations = 0;
+
+        for (auto& block : input)
+        {
+            // reuses the working buffer's storage
+            working = block;
+
+           #if MAKAMIDI_TRACK_ALLOCATIONS
+            const auto allocationsBefore = AllocationGuard::allocationCount();
+           #endif
+            const auto start = std::chrono::steady_clock::now();
+
+            processor.process(working, &pitchWheelValue, &pitchCorrection, table, bank, &activeProgram, &activeNoteNumber);
+
+            const auto end = std::chrono::steady_clock::now();
+           #if MAKAMIDI_TRACK_ALLOCATIONS
+            allocations += AllocationGuard::allocationCount() - allocationsBefore;
+           #endif
+
+            times.push_back((double) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        }
+
+        Result result;
+        result.scenario = scenario.name;
+        result.blockSize = blockSize;
+        result.eventsPerBlock = (double) numEvents / numBlocks;
+
+        double total = 0;
+        for (auto t : times)
+            total += t;
+
+        result.meanNs = total / numBlocks;
+        result.nsPerEvent = numEvents > 0 ? total / (double) numEvents : 0;
+
+        std::sort(times.begin(), times.end());
+        result.p50Ns = percentile(times, 0.5);
+        result.p99Ns = percentile(times, 0.99);
+        result.p999Ns = percentile(times, 0.999);
+        result.maxNs = times.back();
+
+       #if MAKAMIDI_TRACK_ALLOCATIONS
+        result.allocationsPerBlock = (double) allocations / numBlocks;
+       #else
+        (void) allocations;
+       #endif
+
+        return result;
+    }
+
+    void printText(const std::vector<Result>& results)
+    {
+        std::printf("%-18s %6s %9s %9s %10s %10s %10s %10s %10s %8s\n",
+                    "scenario", "block", "events", "ns/event", "mean ns", "p50 ns", "p99 ns", "p99.9 ns", "max ns", "allocs");
+
+        for (auto& r : results)
+        {
+            std::printf("%-18s %6d %9.1f %9.1f %10.0f %10.0f %10.0f %10.0f %10.0f ",
+                        r.scenario.c_str(), r.blockSize, r.eventsPerBlock, r.nsPerEvent, r.meanNs, r.p50Ns, r.p99Ns, r.p999Ns, r.maxNs);
+
+            if (r.allocationsPerBlock < 0)
+                std::printf("%8s\n", "n/a");
+            else
+                std::printf("%8.2f\n", r.allocationsPerBlock);
+        }
+    }
+
+    void printCsv(const std::vector<Result>& results)
+    {
+        std::printf("scenario,block_size,events_per_block,ns_per_event,mean_ns,p50_ns,p99_ns,p999_ns,max_ns,allocations_per_block\n");
+
+        for (auto& r : results)
+            std::printf("%s,%d,%.2f,%.2f,%.1f,%.1f,%.1f,%.1f,%.1f,%.3f\n",
+                        r.scenario.c_str(), r.blockSize, r.eventsPerBlock, r.nsPerEvent, r.meanNs, r.p50Ns, r.p99Ns, r.p999Ns, r.maxNs, r.allocationsPerBlock);
+    }
+
+    void printJson(const std::vector<Result>& results)
+    {
+        std::printf("{\n  \"benchmark\": \"MidiProcessor::process\",\n  \"allocations_tracked\": %s,\n  \"results\": [\n",
+                    MAKAMIDI_TRACK_ALLOCATIONS ? "true" : "false");
+
+        for (std::size_t i = 0; i < results.size(); ++i)
+        {
+            auto& r = results[i];
+            std::printf("    { \"scenario\": \"%s\", \"block_size\": %d, \"events_per_block\": %.2f, \"ns_per_event\": %.2f, "
+                        "\"mean_ns\": %.1f, \"p50_ns\": %.1f, \"p99_ns\": %.1f, \"p999_ns\": %.1f, \"max_ns\": %.1f, ",
+                        r.scenario.c_str(), r.blockSize, r.eventsPerBlock, r.nsPerEvent, r.meanNs, r.p50Ns, r.p99Ns, r.p999Ns, r.maxNs);
+
+            if (r.allocationsPerBlock < 0)
+                std::printf("\"allocations_per_block\": null }");
+            else
+                std::printf("\"allocations_per_block\": %.3f }", r.allocationsPerBlock);
+
+            std::printf(i + 1 < results.size() ? ",\n" : "\n");
+        }
+
+        std::printf("  ]\n}\n");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    enum class Format { text, csv, json } format = Format::text;
+    int numBlocks = 20000;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--json") == 0)
+            format = Format::json;
+        else if (std::strcmp(argv[i], "--csv") == 0)
+            format = Format::csv;
+        else if (std::strcmp(argv[i], "--blocks") == 0 && i + 1 < argc)
+            numBlocks = std::max(100, std::atoi(argv[++i]));
+        else
+        {
+            std::fprintf(stderr, "usage: %s [--json | --csv] [--blocks n]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    const Scenario scenarios[] = {
+        { "sparse-melody",     sparseMelody,    false },
+        { "dense-trill",       denseTrill,      false },
+        { "pitch-wheel-flood", pitchWheelFlood, false },
+        { "worst-case",        worstCase,       true  },
+    };
+
+    std::vector<Result> results;
+
+    for (auto& scenario : scenarios)
+    {
+        if (scenario.worstCaseOnly)
+        {
+            // 8192 events per block is rare enough that fewer blocks still give a stable p99.9
+            results.push_back(run(scenario, worstCaseBlockSize, std::max(100, numBlocks / 10)));
+            continue;
+        }
+
+        for (auto blockSize : blockSizes)
+            results.push_back(run(scenario, blockSize, numBlocks));
+    }
+
+    switch (format)
+    {
+        case Format::text: printText(results); break;
+        case Format::csv:  printCsv(results);  break;
+        case Format::json: printJson(results); break;
+    }
+
+    // the realtime path must not touch the heap: a regression fails the run
+    int status = 0;
+    for (const auto& result : results)
+    {
+        if (result.allocationsPerBlock > 0)
+        {
+            std::fprintf(stderr, "%s, %d samples: %.3f allocations per block\n", result.scenario.c_str(), result.blockSize, result.allocationsPerBlock);
+            status = 1;
+        }
+    }
+
+    return status;
+}
@@ -0,0 +1,136 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    DaemonOptions.h
+
+    Command line of MakaMIDI_Daemon, apart from the daemon so that it builds and is tested
+    without ALSA.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+#include "MidiProcessor.h"
+
+namespace DaemonOptions
+{
+    struct Options
+    {
+        std::string scale, scales;
+        int bendRangeIndex = PitchBend::defaultRangeIndex;
+        int keyswitch = -1;
+        bool exclusive = false;
+        OutputMode mode = OutputMode::mono;
+        bool independentChannels = false;
+        std::vector<std::pair<int, int>> channelPrograms;   // (channel 1 to 16, scale)
+        int priority = 70;
+        int reportSeconds = 10;
+        std::string trace;
+        bool timing = false;
+        std::string timingTrace;
+    };
+
+    inline int bendRangeIndexFor(int semitones)
+    {
+        for (std::size_t i = 0; i < PitchBend::ranges.size(); ++i)
+            if (PitchBend::ranges[i] == semitones)
+                return (int) i;
+        return -1;
+    }
+
+    inline bool parseOutputMode(const std::string& name, OutputMode& mode)
+    {
+        if (name == "mono")
+            mode = OutputMode::mono;
+        else if (name == "mpe")
+            mode = OutputMode::mpe;
+        else if (name == "multi")
+            mode = OutputMode::multiChannel;
+        else
+            return false;
+        return true;
+    }
+
+    // fills options from the arguments; false, with the reason on stderr, if the daemon shouldn't start
+    inline bool parse(int argc, const char* const argv[], Options& options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const bool hasValue = i + 1 < argc;
+
+            if (arg == "--scale" && hasValue)
+                options.scale = argv[++i];
+            else if (arg == "--scales" && hasValue)
+                options.scales = argv[++i];
+            else if (arg == "--bend-range" && hasValue)
+            {
+                if ((options.bendRangeIndex = bendRangeIndexFor(std::atoi(argv[++i]))) < 0)
+                {
+                    std::fprintf(stderr, "--bend-range must be one of 1, 2, 3, 4, 7, 12, 24, 48\n");
+                    return false;
+                }
+            }
+            else if (arg == "--keyswitch" && hasValue)
+                options.keyswitch = std::atoi(argv[++i]);
+            else if (arg == "--exclusive")
+                options.exclusive = true;
+            else if (arg == "--mode" && hasValue)
+            {
+                if (!parseOutputMode(argv[++i], options.mode))
+                {
+                    std::fprintf(stderr, "--mode must be mono, mpe or multi\n");
+                    return false;
+                }
+            }
+            else if (arg == "--independent-channels")
+                options.independentChannels = true;
+            else if (arg == "--channel-program" && hasValue)
+            {
+                const std::string value = argv[++i];
+                const auto separator = value.find('=');
+                const int channel = std::atoi(value.substr(0, separator).c_str());
+
+                if (separator == std::string::npos || channel < 1 || channel > 16)
+                {
+                    std::fprintf(stderr, "--channel-program takes channel=n, channel 1 to 16\n");
+                    return false;
+                }
+
+                options.channelPrograms.emplace_back(channel, std::atoi(value.c_str() + separator + 1));
+                options.independentChannels = true;
+            }
+            else if (arg == "--priority" && hasValue)
+                options.priority = std::atoi(argv[++i]);
+            else if (arg == "--report" && hasValue)
+                options.reportSeconds = std::max(1, std::atoi(argv[++i]));
+            else if (arg == "--trace" && hasValue)
+                options.trace = argv[++i];
+            else if (arg == "--timing")
+                options.timing = true;
+            else if (arg == "--timing-trace" && hasValue)
+                options.timingTrace = argv[++i];
+            else
+            {
+                std::fprintf(stderr, "usage: %s [--scale file] [--scales directory] [--bend-range semitones] [--keyswitch note]\n"
+                                     "       [--exclusive] [--mode mono|mpe|multi] [--independent-channels] [--channel-program channel=n]...\n"
+                                     "       [--priority n] [--report seconds] [--trace file] [--timing] [--timing-trace file]\n", argv[0]);
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
@@ -0,0 +1,523 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    RetuneDaemon.cpp
+
+    Headless retuner for rigs without a DAW (Linux, ALSA sequencer):
+        MakaMIDI_Daemon [--scale file] [--scales directory] [--bend-range semitones]
+                        [--keyswitch note] [--exclusive] [--mode mono|mpe|multi]
+                        [--independent-channels] [--channel-program channel=n]...
+                        [--priority n] [--report seconds] [--trace file]
+                        [--timing] [--timing-trace file]
+
+    Ports: "in" (notes to retune), "out" (retuned notes and pitch wheel) and "control"
+    (Program Change n selects the n-th scale of --scales). With --independent-channels each input
+    channel is retuned on its own, with the scale --channel-program gives it (zones of a split
+    keyboard, several players); Program Change on "in" then switches only its channel. Every event is retuned as soon as
+    it arrives, on a SCHED_FIFO thread with memory locked; the main thread only reports the
+    input to output latency measured with the sequencer's real time queue, and with --trace
+    appends what the engine did (notes, bends, scale switches; times in microseconds) to a file.
+    --timing adds the engine's time per event and its stages to the report, --timing-trace writes
+    every one as a Chrome trace (chrome://tracing, ui.perfetto.dev) on the steady clock.
+
+  ==============================================================================
+*/
+
+#include <alsa/asoundlib.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "DaemonOptions.h"
+#include "MidiProcessor.h"
+#include "ScaleDirectory.h"
+
+namespace
+{
+    using DaemonOptions::Options;
+
+    std::atomic<bool> running { true };
+
+    void stop(int) { running = false; }
+
+    // latency histogram, written by the realtime thread and read by the main thread
+    struct LatencyStats
+    {
+        static constexpr int bucketMicroseconds = 10;
+        static constexpr int numBuckets = 1000; // the last bucket holds everything above 10 ms
+
+        std::array<std::atomic<unsigned>, numBuckets> buckets {};
+        std::atomic<unsigned long long> count { 0 }, totalNanoseconds { 0 }, maxNanoseconds { 0 };
+
+        void add(long long nanoseconds) noexcept
+        {
+            nanoseconds = std::max(0LL, nanoseconds);
+            const auto bucket = std::min((long long) numBuckets - 1, nanoseconds / (bucketMicroseconds * 1000));
+            buckets[(std::size_t) bucket].fetch_add(1, std::memory_order_relaxed);
+            count.fetch_add(1, std::memory_order_relaxed);
+            totalNanoseconds.fetch_add((unsigned long long) nanoseconds, std::memory_order_relaxed);
+
+            auto previous = maxNanoseconds.load(std::memory_order_relaxed);
+            while ((unsigned long long) nanoseconds > previous
+                   && !maxNanoseconds.compare_exchange_weak(previous, (unsigned long long) nanoseconds, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        // upper bound of the bucket holding the given fraction of the events
+        double percentileMicroseconds(double fraction) const noexcept
+        {
+            const auto n = count.load(std::memory_order_relaxed);
+            unsigned long long seen = 0;
+
+            for (int i = 0; i < numBuckets; ++i)
+            {
+                seen += buckets[(std::size_t) i].load(std::memory_order_relaxed);
+                if ((double) seen >= fraction * (double) n)
+                    return (i + 1) * bucketMicroseconds;
+            }
+
+            return numBuckets * bucketMicroseconds;
+        }
+    };
+
+    class Daemon
+    {
+    public:
+        explicit Daemon(const Options& options) : options(options) {}
+
+        ~Daemon()
+        {
+            if (decoder != nullptr)     snd_midi_event_free(decoder);
+            if (encoder != nullptr)     snd_midi_event_free(encoder);
+            if (queueStatus != nullptr) snd_seq_queue_status_free(queueStatus);
+            if (seq != nullptr)         snd_seq_close(seq);
+        }
+
+        bool open()
+        {
+            if (snd_seq_open(&seq, "default", SND_SEQ_OPEN_DUPLEX, SND_SEQ_NONBLOCK) < 0)
+            {
+                std::fprintf(stderr, "cannot open the ALSA sequencer\n");
+                return false;
+            }
+
+            snd_seq_set_client_name(seq, "MakaMIDI");
+
+            // arrival times are stamped by the sequencer on this queue
+            queue = snd_seq_alloc_named_queue(seq, "MakaMIDI latency");
+            inPort = createPort("in", SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE, true);
+            controlPort = createPort("control", SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE, true);
+            outPort = createPort("out", SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ, false);
+
+            if (queue < 0 || inPort < 0 || controlPort < 0 || outPort < 0
+                || snd_midi_event_new(maxMessageBytes, &decoder) < 0
+                || snd_midi_event_new(maxMessageBytes, &encoder) < 0
+                || snd_seq_queue_status_malloc(&queueStatus) < 0)
+            {
+                std::fprintf(stderr, "cannot create the sequencer ports\n");
+                return false;
+            }
+
+            // every decoded message carries its status byte: the engine reads messages one by one
+            snd_midi_event_no_status(decoder, 1);
+
+            snd_seq_start_queue(seq, queue, nullptr);
+            snd_seq_drain_output(seq);
+
+            std::printf("MakaMIDI: ALSA client %d, ports in %d, control %d, out %d\n",
+                        snd_seq_client_id(seq), inPort, controlPort, outPort);
+            return true;
+        }
+
+        bool loadScales()
+        {
+            if (!options.scales.empty())
+            {
+                for (auto& scale : ScaleDirectory::loadAll(options.scales))
+                {
+                    if (bank.numPrograms >= TuningBank::maxPrograms)
+                        break;
+
+                    std::printf("program %d: %s\n", bank.numPrograms, scale.name.c_str());
+                    bank.add(scale.table);
+                }
+            }
+
+            if (!options.scale.empty())
+            {
+                auto table = ScaleDirectory::load(options.scale);
+                if (table == nullptr)
+                    return false;
+                editableTable = *table;
+            }
+            else if (bank.numPrograms > 0)
+            {
+                processor.requestProgram(0);
+            }
+            else
+            {
+                std::fprintf(stderr, "no scale: use --scale and/or --scales\n");
+                return false;
+            }
+
+            return true;
+        }
+
+        // retunes events until stopped; runs on the realtime thread
+        void run()
+        {
+            processor.prepare(maxEventsPerMessage);
+            processor.setBendRange(options.bendRangeIndex);
+            processor.setSwitching(true, options.keyswitch);
+            processor.setExclusive(options.exclusive);
+            processor.setOutputMode(options.mode);
+            processor.setIndependentChannels(options.independentChannels);
+            if (!options.trace.empty())
+                processor.setTrace(&trace);
+            if (options.timing || !options.timingTrace.empty())
+                processor.setProfiler(&profiler);
+            profiler.setTimeline(!options.timingTrace.empty());
+            threadId = (int) syscall(SYS_gettid);
+            for (const auto& [channel, program] : options.channelPrograms)
+                processor.requestChannelProgram(channel, program);
+            // the output comes back in the same buffer
+            input.ensureSize(processor.getOutputCapacity());
+
+            // the synth's bend range and the first scale go out right away
+            flush(process());
+
+            const int numDescriptors = snd_seq_poll_descriptors_count(seq, POLLIN);
+            std::array<pollfd, 8> descriptors {};
+            snd_seq_poll_descriptors(seq, descriptors.data(), (unsigned) std::min(numDescriptors, (int) descriptors.size()), POLLIN);
+
+            while (running.load(std::memory_order_relaxed))
+            {
+                if (poll(descriptors.data(), (nfds_t) std::min(numDescriptors, (int) descriptors.size()), 100) <= 0)
+                    continue;
+
+                snd_seq_event_t* event = nullptr;
+
+                while (snd_seq_event_input(seq, &event) >= 0 && event != nullptr)
+                {
+                    handle(*event);
+                    event = nullptr;
+                }
+            }
+        }
+
+        LatencyStats latency;
+
+        // writes the records of the realtime thread to file (main thread)
+        void drainTrace(std::FILE* file)
+        {
+            char text[128];
+
+            if (const auto dropped = trace.takeDropped())
+                std::fprintf(file, "# %llu records dropped\n", (unsigned long long) dropped);
+
+            trace.drain([&](const TraceRecord& record) {
+                if (record.format(text, sizeof(text)) > 0)
+                    std::fputs(text, file);
+            });
+
+            std::fflush(file);
+        }
+
+        // writes the block timings of the realtime thread as Chrome trace events (main thread)
+        void drainTimeline(std::FILE* file)
+        {
+            char text[1024];
+            const double ticksPerMicrosecond = profiler.getClock().getTicksPerMicrosecond();
+            const int tid = threadId.load();
+
+            if (!timelineStarted && BlockTiming::formatTraceStart(text, sizeof(text), "MakaMIDI engine", (int) getpid(), tid) > 0)
+            {
+                std::fputs(text, file);
+                timelineStarted = true;
+            }
+
+            if (const auto dropped = profiler.takeDroppedTimeline())
+                std::fprintf(file, "{\"name\":\"%llu blocks dropped\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d},\n",
+                             (unsigned long long) dropped, profiler.getClock().toSteadyMicroseconds(CycleClock::now(), ticksPerMicrosecond),
+                             (int) getpid(), tid);
+
+            profiler.drainTimeline([&](const BlockTiming& timing) {
+                if (timing.format(text, sizeof(text), profiler.getClock(), ticksPerMicrosecond, (int) getpid(), tid) > 0)
+                    std::fputs(text, file);
+            });
+
+            std::fflush(file);
+        }
+
+        const BlockProfiler& getProfiler() const { return profiler; }
+
+    private:
+        static constexpr int maxMessageBytes = 256;
+        // a single message turns into at most a few output events; the bend range setup is 96
+        static constexpr int maxEventsPerMessage = 128;
+
+        const Options options;
+
+        snd_seq_t* seq = nullptr;
+        snd_midi_event_t* decoder = nullptr;
+        snd_midi_event_t* encoder = nullptr;
+        snd_seq_queue_status_t* queueStatus = nullptr;
+        int queue = -1, inPort = -1, controlPort = -1, outPort = -1;
+
+        MidiProcessor processor;
+        TraceBuffer trace;
+        BlockProfiler profiler;
+        std::atomic<int> threadId { 0 };
+        bool timelineStarted = false; // main thread only
+        const std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+        MidiEventBuffer input;
+        TuningTable editableTable;
+        TuningBank bank;
+
+        int pitchWheelValue = PitchBend::centre;
+        int pitchCorrection = 0;
+        int activeProgram = -1;
+        int activeNoteNumber = -1;
+
+        int createPort(const char* name, unsigned capabilities, bool timestamped)
+        {
+            snd_seq_port_info_t* info = nullptr;
+            snd_seq_port_info_alloca(&info);
+            snd_seq_port_info_set_name(info, name);
+            snd_seq_port_info_set_capability(info, capabilities);
+            snd_seq_port_info_set_type(info, SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+
+            if (timestamped)
+            {
+                snd_seq_port_info_set_timestamping(info, 1);
+                snd_seq_port_info_set_timestamp_real(info, 1);
+                snd_seq_port_info_set_timestamp_queue(info, queue);
+            }
+
+            if (snd_seq_create_port(seq, info) < 0)
+                return -1;
+
+            return snd_seq_port_info_get_port(info);
+        }
+
+        MidiEventBuffer& process()
+        {
+            if (!options.trace.empty())
+                processor.setTraceTime(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count());
+
+            processor.process(input, &pitchWheelValue, &pitchCorrection, editableTable, bank, &activeProgram, &activeNoteNumber);
+            return input;
+        }
+
+        void handle(const snd_seq_event_t& event)
+        {
+            std::uint8_t bytes[maxMessageBytes];
+            const long numBytes = snd_midi_event_decode(decoder, bytes, maxMessageBytes, &event);
+
+            if (numBytes <= 0)
+                return;
+
+            // control port: Program Change selects a scale, whatever channel it comes on
+            if (event.dest.port == controlPort)
+            {
+                if ((bytes[0] & 0xf0) == 0xc0 && numBytes >= 2)
+                {
+                    processor.requestProgram(bytes[1]);
+                    input.clear();
+                    flush(process());
+                }
+                return;
+            }
+
+            input.clear();
+            input.addEvent(bytes, (int) numBytes, 0);
+            flush(process());
+
+            if ((event.flags & SND_SEQ_TIME_STAMP_MASK) == SND_SEQ_TIME_STAMP_REAL)
+                measure(event.time.time);
+        }
+
+        void flush(const MidiEventBuffer& output)
+        {
+            for (const auto message : output)
+            {
+                snd_seq_event_t event;
+                snd_seq_ev_clear(&event);
+                snd_midi_event_reset_encode(encoder);
+
+                if (snd_midi_event_encode(encoder, message.data, message.numBytes, &event) <= 0 || event.type == SND_SEQ_EVENT_NONE)
+                    continue;
+
+                snd_seq_ev_set_source(&event, outPort);
+                snd_seq_ev_set_subs(&event);
+                snd_seq_ev_set_direct(&event);
+                snd_seq_event_output_direct(seq, &event);
+            }
+        }
+
+        // from the sequencer's arrival stamp to now, once the output is on its way
+        void measure(const snd_seq_real_time_t& arrival)
+        {
+            if (snd_seq_get_queue_status(seq, queue, queueStatus) < 0)
+                return;
+
+            const auto* now = snd_seq_queue_status_get_real_time(queueStatus);
+            const long long nanoseconds = ((long long) now->tv_sec - (long long) arrival.tv_sec) * 1000000000LL
+                                        + ((long long) now->tv_nsec - (long long) arrival.tv_nsec);
+            latency.add(nanoseconds);
+        }
+    };
+
+    void report(const LatencyStats& latency)
+    {
+        const auto n = latency.count.load();
+        if (n == 0)
+            return;
+
+        const double mean = (double) latency.totalNanoseconds.load() / (double) n / 1000.0;
+        const double p99 = latency.percentileMicroseconds(0.99);
+
+        std::printf("latency: %llu events, mean %.1f us, p99 < %.0f us, p99.9 < %.0f us, max %.1f us%s\n",
+                    n, mean, p99, latency.percentileMicroseconds(0.999), (double) latency.maxNanoseconds.load() / 1000.0,
+                    p99 > 1000.0 ? "  (above the 1 ms target)" : "");
+        std::fflush(stdout);
+    }
+
+    void reportTiming(const BlockProfiler& profiler)
+    {
+        char text[512];
+
+        if (profiler.getBlockTimes().count == 0 || profiler.formatSummary(text, sizeof(text)) <= 0)
+            return;
+
+        std::printf("timing: %s", text);
+        std::fflush(stdout);
+    }
+
+    // the processing thread: SCHED_FIFO, with everything it touches already in memory
+    void* realtimeThread(void* daemon)
+    {
+        static_cast<Daemon*>(daemon)->run();
+        return nullptr;
+    }
+
+    bool startRealtimeThread(pthread_t& thread, Daemon& daemon, int priority)
+    {
+        pthread_attr_t attributes;
+        pthread_attr_init(&attributes);
+        pthread_attr_setinheritsched(&attributes, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attributes, SCHED_FIFO);
+
+        sched_param parameters {};
+        parameters.sched_priority = std::clamp(priority, sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO));
+        pthread_attr_setschedparam(&attributes, &parameters);
+
+        int result = pthread_create(&thread, &attributes, realtimeThread, &daemon);
+        pthread_attr_destroy(&attributes);
+
+        if (result == EPERM)
+        {
+            std::fprintf(stderr, "warning: no permission for realtime scheduling (see /etc/security/limits.conf), running SCHED_OTHER\n");
+            result = pthread_create(&thread, nullptr, realtimeThread, &daemon);
+        }
+
+        return result == 0;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+
+    if (!DaemonOptions::parse(argc, argv, options))
+        return 2;
+
+    Daemon daemon(options);
+
+    if (!daemon.loadScales() || !daemon.open())
+        return 1;
+
+    std::FILE* traceFile = nullptr;
+    if (!options.trace.empty() && (traceFile = std::fopen(options.trace.c_str(), "a")) == nullptr)
+    {
+        std::fprintf(stderr, "%s: cannot open the trace file\n", options.trace.c_str());
+        return 1;
+    }
+
+    // a JSON array: started afresh, and readable even when the daemon is killed before closing it
+    std::FILE* timelineFile = nullptr;
+    if (!options.timingTrace.empty() && (timelineFile = std::fopen(options.timingTrace.c_str(), "w")) == nullptr)
+    {
+        std::fprintf(stderr, "%s: cannot open the timing trace file\n", options.timingTrace.c_str());
+        return 1;
+    }
+
+    // no page faults on the realtime thread
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+        std::fprintf(stderr, "warning: cannot lock memory (%s)\n", std::strerror(errno));
+
+    std::signal(SIGINT, stop);
+    std::signal(SIGTERM, stop);
+
+    pthread_t thread;
+    if (!startRealtimeThread(thread, daemon, options.priority))
+    {
+        std::fprintf(stderr, "cannot start the processing thread\n");
+        return 1;
+    }
+
+    for (int elapsed = 0; running; ++elapsed)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        if (elapsed % options.reportSeconds == options.reportSeconds - 1)
+        {
+            report(daemon.latency);
+            if (options.timing)
+                reportTiming(daemon.getProfiler());
+        }
+        if (traceFile != nullptr)
+            daemon.drainTrace(traceFile);
+        if (timelineFile != nullptr)
+            daemon.drainTimeline(timelineFile);
+    }
+
+    pthread_join(thread, nullptr);
+    report(daemon.latency);
+    if (options.timing)
+        reportTiming(daemon.getProfiler());
+
+    if (timelineFile != nullptr)
+    {
+        daemon.drainTimeline(timelineFile);
+        std::fprintf(timelineFile, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"MakaMIDI_Daemon\"}}]\n", (int) getpid());
+        std::fclose(timelineFile);
+    }
+
+    if (traceFile != nullptr)
+    {
+        daemon.drainTrace(traceFile);
+        std::fclose(traceFile);
+    }
+
+    return 0;
+}
@@ -0,0 +1,143 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    ScaleCompiler.cpp
+
+    Converts scale CSVs to compiled tunings (.mkt) and back:
+        MakaMIDI_ScaleCompiler <file.csv | file.mkt | directory> [output]
+
+  ==============================================================================
+*/
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "ScaleParser.h"
+
+namespace fs = std::filesystem;
+
+static bool readFile(const fs::path& path, std::vector<char>& contents)
+{
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream)
+        return false;
+
+    contents.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static bool writeCsv(const fs::path& path, const TuningTable& table)
+{
+    static const char* noteNames[] = { "C", "C#/Db", "D", "D#/Eb", "E", "F", "F#/Gb", "G", "G#/Ab", "A", "A#/Bb", "B" };
+
+    std::ofstream stream(path, std::ios::binary);
+    for (int i = 0; i < TuningTable::numNotes; ++i)
+    {
+        if (table.isExcluded(i))
+            continue;
+        stream << i << ',' << table[i] << ',' << noteNames[i % 12];
+
+        // ascending and descending alterations, only where they differ from the plain one
+        const int ascending = table.get(i, TuningTable::ascending);
+        const int descending = table.get(i, TuningTable::descending);
+        if (ascending != table[i] || descending != table[i])
+            stream << ',' << ascending << ',' << descending;
+
+        stream << '\n';
+    }
+    return (bool) stream;
+}
+
+// converts one file, returns false on errors
+static bool convert(const fs::path& input, fs::path output)
+{
+    std::vector<char> contents;
+    if (!readFile(input, contents))
+    {
+        std::fprintf(stderr, "%s: cannot read file\n", input.string().c_str());
+        return false;
+    }
+
+    const auto result = ScaleParser::parse(contents.data(), contents.size());
+
+    for (auto& d : result.diagnostics)
+        std::fprintf(stderr, "%s:%d: %s: %s\n", input.string().c_str(), d.line,
+                     d.severity == ScaleDiagnostic::Severity::error ? "error" : "warning", d.message.c_str());
+
+    if (result.hasErrors())
+        return false;
+
+    // compiled tunings are decompiled, anything else is compiled
+    const bool decompile = CompiledTuning::hasSignature(contents.data(), contents.size());
+
+    if (output.empty())
+        output = fs::path(input).replace_extension(decompile ? ".csv" : CompiledTuning::fileExtension);
+
+    if (decompile)
+    {
+        if (!writeCsv(output, result.table))
+        {
+            std::fprintf(stderr, "%s: cannot write file\n", output.string().c_str());
+            return false;
+        }
+    }
+    else
+    {
+        const auto bytes = CompiledTuning::write(result.table);
+        std::ofstream stream(output, std::ios::binary);
+        stream.write(reinterpret_cast<const char*>(bytes.data()), (std::streamsize) bytes.size());
+
+        if (!stream)
+        {
+            std::fprintf(stderr, "%s: cannot write file\n", output.string().c_str());
+            return false;
+        }
+    }
+
+    std::printf("%s -> %s\n", input.string().c_str(), output.string().c_str());
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2 || argc > 3)
+    {
+        std::fprintf(stderr, "usage: %s <file.csv | file.mkt | directory> [output]\n", argv[0]);
+        return 2;
+    }
+
+    const fs::path input(argv[1]);
+    const fs::path output(argc > 2 ? argv[2] : "");
+    std::error_code ec;
+
+    if (!fs::is_directory(input, ec))
+        return convert(input, output) ? 0 : 1;
+
+    // compile every CSV in the directory, into the output directory if one is given
+    if (!output.empty())
+        fs::create_directories(output, ec);
+
+    int failures = 0;
+    for (auto& entry : fs::directory_iterator(input, ec))
+    {
+        if (!entry.is_regular_file() || entry.path().extension() != ".csv")
+            continue;
+
+        fs::path target;
+        if (!output.empty())
+            target = (output / entry.path().filename()).replace_extension(CompiledTuning::fileExtension);
+
+        if (!convert(entry.path(), target))
+            ++failures;
+    }
+
+    return failures == 0 ? 0 : 1;
+}
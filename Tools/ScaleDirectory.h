@@ -0,0 +1,81 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    ScaleDirectory.h
+
+    Scale loading shared by the command line tools, which have no MakamLibrary.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ScaleParser.h"
+
+namespace ScaleDirectory
+{
+    struct Scale
+    {
+        std::string name;
+        std::shared_ptr<const TuningTable> table;
+    };
+
+    // "Midi makam notation - Hicaz.csv" is Hicaz, as in the plugin's library
+    inline std::string nameFromFile(const std::filesystem::path& file)
+    {
+        auto name = file.stem().string();
+        const auto separator = name.rfind(" - ");
+        if (separator != std::string::npos)
+            name = name.substr(separator + 3);
+        return name;
+    }
+
+    inline bool isScaleFile(const std::filesystem::path& file)
+    {
+        return file.extension() == ".csv" || file.extension() == CompiledTuning::fileExtension;
+    }
+
+    // parses one scale, reporting its diagnostics on stderr; returns nullptr if it has errors
+    inline std::shared_ptr<const TuningTable> load(const std::filesystem::path& file)
+    {
+        const auto result = ScaleParser::parseFile(file.string());
+
+        for (auto& d : result.diagnostics)
+            std::fprintf(stderr, "%s:%d: %s: %s\n", file.string().c_str(), d.line,
+                         d.severity == ScaleDiagnostic::Severity::error ? "error" : "warning", d.message.c_str());
+
+        if (result.hasErrors())
+            return nullptr;
+
+        return std::make_shared<const TuningTable>(result.table);
+    }
+
+    // every valid scale of the directory, sorted by name: the programs of a TuningBank, in order
+    inline std::vector<Scale> loadAll(const std::filesystem::path& directory)
+    {
+        std::vector<Scale> scales;
+        std::error_code ec;
+
+        for (auto& entry : std::filesystem::directory_iterator(directory, ec))
+            if (entry.is_regular_file() && isScaleFile(entry.path()))
+                if (auto table = load(entry.path()))
+                    scales.push_back({ nameFromFile(entry.path()), std::move(table) });
+
+        if (ec)
+            std::fprintf(stderr, "%s: %s\n", directory.string().c_str(), ec.message().c_str());
+
+        std::sort(scales.begin(), scales.end(), [](const Scale& a, const Scale& b) { return a.name < b.name; });
+        return scales;
+    }
+}
@@ -0,0 +1,82 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    ScaleExporter.cpp
+
+    Exports scales as Scala (.scl + .kbm) and AnaMark (.tun) tunings, one scale or a whole folder:
+        MakaMIDI_ScaleExporter <file.csv | file.mkt | directory> [output directory]
+
+  ==============================================================================
+*/
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include "ScaleDirectory.h"
+#include "TuningExport.h"
+
+namespace fs = std::filesystem;
+
+static bool writeText(const fs::path& path, const std::string& text)
+{
+    std::ofstream stream(path, std::ios::binary);
+    stream << text;
+
+    if (!stream)
+        std::fprintf(stderr, "%s: cannot write file\n", path.string().c_str());
+    return (bool) stream;
+}
+
+// writes name.scl, name.kbm and name.tun in directory, returns false on errors
+static bool exportScale(const std::string& name, const TuningTable& table, const fs::path& directory)
+{
+    const auto base = directory / name;
+
+    const bool written = writeText(fs::path(base).concat(".scl"), TuningExport::toScl(table, name))
+                      && writeText(fs::path(base).concat(".kbm"), TuningExport::toKbm(table, name))
+                      && writeText(fs::path(base).concat(".tun"), TuningExport::toTun(table, name));
+
+    if (written)
+        std::printf("%s -> %s.scl/.kbm/.tun%s\n", name.c_str(), base.string().c_str(),
+                    TuningExport::isOctavePeriodic(table) ? "" : " (one degree per note)");
+    return written;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2 || argc > 3)
+    {
+        std::fprintf(stderr, "usage: %s <file.csv | file.mkt | directory> [output directory]\n", argv[0]);
+        return 2;
+    }
+
+    const fs::path input(argv[1]);
+    std::error_code ec;
+    const bool batch = fs::is_directory(input, ec);
+
+    // next to the input by default
+    fs::path output(argc > 2 ? argv[2] : (batch ? input : input.parent_path()));
+    if (output.empty())
+        output = ".";
+    fs::create_directories(output, ec);
+
+    if (!batch)
+    {
+        const auto table = ScaleDirectory::load(input);
+        return table != nullptr && exportScale(ScaleDirectory::nameFromFile(input), *table, output) ? 0 : 1;
+    }
+
+    // every scale of the folder in one pass, the invalid ones reported by loadAll
+    int failures = 0;
+    for (auto& scale : ScaleDirectory::loadAll(input))
+        if (!exportScale(scale.name, *scale.table, output))
+            ++failures;
+
+    return failures == 0 ? 0 : 1;
+}
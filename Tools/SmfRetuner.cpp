@@ -0,0 +1,631 @@
+/*
+  ==============================================================================
+
+    MakaMIDI
+    Copyright (c) 2025 Mattia Vassena
+    Licensed under the MIT License.
+    See LICENSE file in the project root for full license information.
+
+    SmfRetuner.cpp
+
+    Retunes Standard MIDI Files offline with the plugin's engine:
+        MakaMIDI_SmfRetuner --scale file [--track n=file ...] [--bend-range semitones]
+                            [--exclusive] [--threads n] [--output directory] <file.mid | directory> ...
+
+    Each track runs through its own engine, with the --scale table or the one given for its
+    index (0 is the first MTrk chunk). Files are read and written as a stream, the engine taking
+    the events of one tick at a time, and spread over a work-stealing pool of threads. Directories are searched recursively
+    and mirrored in the output directory; without --output, "name-retuned.mid" is written next
+    to each input.
+
+  ==============================================================================
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "MidiProcessor.h"
+#include "ScaleDirectory.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    struct Options
+    {
+        std::shared_ptr<const TuningTable> scale;
+        std::map<int, std::shared_ptr<const TuningTable>> trackScales;
+        int bendRangeIndex = -1; // no RPN setup unless asked for
+        bool exclusive = false;
+        unsigned numThreads = std::max(1u, std::thread::hardware_concurrency());
+        fs::path output;
+    };
+
+    struct Job
+    {
+        fs::path input, output;
+    };
+
+    struct Totals
+    {
+        std::atomic<unsigned long long> events { 0 }, bytes { 0 };
+        std::atomic<int> files { 0 }, failures { 0 };
+    };
+
+    //==============================================================================
+    // buffered reader over the bytes of one chunk
+    class ChunkReader
+    {
+    public:
+        ChunkReader(std::istream& stream, std::uint32_t length) : stream(stream), remaining(length) {}
+
+        bool atEnd() const noexcept { return remaining == 0 && position == available; }
+        bool failed() const noexcept { return error; }
+
+        std::uint8_t read()
+        {
+            if (position == available && !refill())
+            {
+                error = true;
+                return 0;
+            }
+            return buffer[position++];
+        }
+
+        std::uint32_t readVariableLength()
+        {
+            std::uint32_t value = 0;
+            for (int i = 0; i < 4; ++i)
+            {
+                const auto byte = read();
+                value = (value << 7) | (byte & 0x7f);
+                if ((byte & 0x80) == 0)
+                    return value;
+            }
+            error = true;
+            return value;
+        }
+
+    private:
+        static constexpr std::size_t bufferSize = 1 << 16;
+
+        std::istream& stream;
+        std::uint32_t remaining;
+        std::vector<std::uint8_t> buffer = std::vector<std::uint8_t>(bufferSize);
+        std::size_t position = 0, available = 0;
+        bool error = false;
+
+        bool refill()
+        {
+            const auto n = (std::size_t) std::min<std::uint32_t>(remaining, (std::uint32_t) bufferSize);
+            if (n == 0 || !stream.read(reinterpret_cast<char*>(buffer.data()), (std::streamsize) n))
+                return false;
+
+            remaining -= (std::uint32_t) n;
+            position = 0;
+            available = n;
+            return true;
+        }
+    };
+
+    void writeBigEndian(std::ostream& stream, std::uint32_t value, int numBytes)
+    {
+        for (int i = numBytes - 1; i >= 0; --i)
+            stream.put((char) ((value >> (8 * i)) & 0xff));
+    }
+
+    void writeVariableLength(std::ostream& stream, std::uint32_t value)
+    {
+        std::uint8_t bytes[4];
+        int n = 0;
+
+        do
+        {
+            bytes[n++] = (std::uint8_t) (value & 0x7f);
+            value >>= 7;
+        } while (value != 0 && n < 4);
+
+        while (n > 1)
+            stream.put((char) (bytes[--n] | 0x80));
+        stream.put((char) bytes[0]);
+    }
+
+    std::uint32_t readBigEndian(std::istream& stream, int numBytes)
+    {
+        std::uint32_t value = 0;
+        for (int i = 0; i < numBytes; ++i)
+            value = (value << 8) | (std::uint8_t) stream.get();
+        return value;
+    }
+
+    //==============================================================================
+    // retunes one MTrk chunk, writing it as it is read
+    class TrackRetuner
+    {
+    public:
+        TrackRetuner(const TuningTable& table, const Options& options, std::ostream& out)
+            : table(table), out(out)
+        {
+            processor.prepare(0);
+            buffer.ensureSize(processor.getOutputCapacity());
+            processor.setSwitching(false, -1);
+            processor.setExclusive(options.exclusive);
+
+            if (options.bendRangeIndex >= 0)
+                processor.setBendRange(options.bendRangeIndex);
+        }
+
+        // returns the number of events read, or -1 if the track is malformed
+        long long run(ChunkReader& in)
+        {
+            long long numEvents = 0;
+            std::uint8_t runningStatus = 0;
+            bool endOfTrack = false;
+
+            while (!in.atEnd() && !endOfTrack)
+            {
+                const auto delta = in.readVariableLength();
+
+                // the tick moves on: its events are complete
+                if (delta != 0)
+                    flushBatch();
+
+                tick += delta;
+                std::uint8_t status = in.read();
+
+                if (in.failed())
+                    return -1;
+
+                ++numEvents;
+
+                if (status == 0xff)
+                {
+                    flushBatch();
+                    const auto type = in.read();
+                    const auto length = in.readVariableLength();
+                    endOfTrack = type == 0x2f;
+
+                    if (!endOfTrack)
+                    {
+                        const std::uint8_t header[] = { 0xff, type };
+                        writeDelta();
+                        out.write(reinterpret_cast<const char*>(header), 2);
+                        writeVariableLength(out, length);
+                    }
+
+                    copy(in, length, !endOfTrack);
+                }
+                else if (status == 0xf0 || status == 0xf7)
+                {
+                    // system exclusive: copied as is, it also cancels running status
+                    flushBatch();
+                    const auto length = in.readVariableLength();
+                    writeDelta();
+                    out.put((char) status);
+                    writeVariableLength(out, length);
+                    copy(in, length, true);
+                    runningStatus = 0;
+                }
+                else if (status > 0xf0)
+                {
+                    // system common and realtime messages have no place in a file
+                    return -1;
+                }
+                else
+                {
+                    std::uint8_t message[3];
+                    int numBytes = 0;
+
+                    if (status < 0x80)
+                    {
+                        if (runningStatus == 0)
+                            return -1;
+
+                        message[numBytes++] = runningStatus;
+                        message[numBytes++] = status;
+                    }
+                    else
+                    {
+                        runningStatus = status;
+                        message[numBytes++] = status;
+                        message[numBytes++] = in.read();
+                    }
+
+                    const int type = message[0] & 0xf0;
+                    if (type != 0xc0 && type != 0xd0)
+                        message[numBytes++] = in.read();
+
+                    if (in.failed())
+                        return -1;
+
+                    addToBatch(message, numBytes);
+                }
+            }
+
+            flushBatch();
+
+            // always end the track properly, even if the input forgot to
+            const std::uint8_t end[] = { 0xff, 0x2f, 0x00 };
+            writeDelta();
+            out.write(reinterpret_cast<const char*>(end), 3);
+
+            return in.failed() ? -1 : numEvents;
+        }
+
+    private:
+        const TuningTable& table;
+        const TuningBank bank;
+        std::ostream& out;
+
+        // channel messages of the current tick, retuned together when it ends
+        static constexpr int maxBatchEvents = 1024;
+
+        MidiProcessor processor;
+        MidiEventBuffer buffer;
+        int numBatchEvents = 0;
+        int pitchWheelValue = PitchBend::centre;
+        int pitchCorrection = 0;
+        int activeProgram = -1;
+        int activeNoteNumber = -1;
+
+        std::uint64_t tick = 0, writtenTick = 0;
+
+        void writeDelta()
+        {
+            writeVariableLength(out, (std::uint32_t) (tick - writtenTick));
+            writtenTick = tick;
+        }
+
+        // full status bytes on output: the engine may interleave channels
+        void writeEvent(const std::uint8_t* data, int numBytes)
+        {
+            writeDelta();
+            out.write(reinterpret_cast<const char*>(data), numBytes);
+        }
+
+        /*
+            @brief
+            the engine sees every channel message of a tick in one block, as the plugin sees a host buffer: a
+            note ending where the next one starts shares one bend, and the messages it doesn't retune keep
+            their place among the notes. A very busy tick is split, to stay within the engine's buffers
+        */
+        void addToBatch(const std::uint8_t* message, int numBytes)
+        {
+            if (numBatchEvents == maxBatchEvents)
+                flushBatch();
+
+            buffer.addEvent(message, numBytes, 0);
+            ++numBatchEvents;
+        }
+
+        void flushBatch()
+        {
+            if (numBatchEvents == 0)
+                return;
+
+            processor.process(buffer, &pitchWheelValue, &pitchCorrection, table, bank, &activeProgram, &activeNoteNumber);
+
+            for (const auto event : buffer)
+                writeEvent(event.data, event.numBytes);
+
+            buffer.clear();
+            numBatchEvents = 0;
+        }
+
+        void copy(ChunkReader& in, std::uint32_t length, bool write)
+        {
+            for (std::uint32_t i = 0; i < length && !in.failed(); ++i)
+            {
+                const auto byte = in.read();
+                if (write)
+                    out.put((char) byte);
+            }
+        }
+    };
+
+    // returns the number of events, or -1 on errors
+    long long retuneFile(const Job& job, const Options& options)
+    {
+        std::ifstream in(job.input, std::ios::binary);
+        char id[4];
+
+        if (!in.read(id, 4) || std::string(id, 4) != "MThd")
+        {
+            std::fprintf(stderr, "%s: not a Standard MIDI File\n", job.input.string().c_str());
+            return -1;
+        }
+
+        const auto headerLength = readBigEndian(in, 4);
+        std::vector<char> header(headerLength);
+        if (headerLength < 6 || !in.read(header.data(), (std::streamsize) headerLength))
+        {
+            std::fprintf(stderr, "%s: invalid header\n", job.input.string().c_str());
+            return -1;
+        }
+
+        std::error_code ec;
+        fs::create_directories(job.output.parent_path(), ec);
+        std::ofstream out(job.output, std::ios::binary);
+
+        out.write("MThd", 4);
+        writeBigEndian(out, headerLength, 4);
+        out.write(header.data(), (std::streamsize) headerLength);
+
+        long long numEvents = 0;
+
+        for (int track = 0; in.read(id, 4); )
+        {
+            const auto length = readBigEndian(in, 4);
+            ChunkReader reader(in, length);
+
+            out.write(id, 4);
+            const auto lengthPosition = out.tellp();
+            writeBigEndian(out, 0, 4);
+
+            if (std::string(id, 4) == "MTrk")
+            {
+                const auto found = options.trackScales.find(track++);
+                const auto& table = found != options.trackScales.end() ? *found->second : *options.scale;
+
+                TrackRetuner retuner(table, options, out);
+                const auto n = retuner.run(reader);
+
+                if (n < 0)
+                {
+                    std::fprintf(stderr, "%s: track %d is malformed\n", job.input.string().c_str(), track - 1);
+                    out.close();
+                    fs::remove(job.output, ec);
+                    return -1;
+                }
+
+                numEvents += n;
+
+                // skip whatever follows the end of track in the chunk
+                while (!reader.atEnd() && !reader.failed())
+                    reader.read();
+            }
+            else
+            {
+                // unknown chunks are copied
+                while (!reader.atEnd() && !reader.failed())
+                    out.put((char) reader.read());
+            }
+
+            // the chunk's length is known once it is written
+            const auto end = out.tellp();
+            out.seekp(lengthPosition);
+            writeBigEndian(out, (std::uint32_t) (end - lengthPosition - 4), 4);
+            out.seekp(end);
+        }
+
+        if (!out)
+        {
+            std::fprintf(stderr, "%s: cannot write file\n", job.output.string().c_str());
+            out.close();
+            fs::remove(job.output, ec);
+            return -1;
+        }
+
+        return numEvents;
+    }
+
+    //==============================================================================
+    /*
+        @brief
+        each worker takes jobs from the front of its own queue, and steals from the back of
+        the others' when it runs out: long files don't leave the other cores idle
+    */
+    class WorkStealingPool
+    {
+    public:
+        WorkStealingPool(std::vector<Job> jobs, unsigned numWorkers)
+            : queues(std::max(1u, numWorkers))
+        {
+            for (std::size_t i = 0; i < jobs.size(); ++i)
+                queues[i % queues.size()].jobs.push_back(std::move(jobs[i]));
+        }
+
+        template <typename Function>
+        void run(Function&& function)
+        {
+            std::vector<std::thread> workers;
+
+            for (std::size_t i = 0; i < queues.size(); ++i)
+                workers.emplace_back([this, i, &function] {
+                    Job job;
+                    while (take(i, job))
+                        function(job);
+                });
+
+            for (auto& worker : workers)
+                worker.join();
+        }
+
+    private:
+        struct Queue
+        {
+            std::mutex lock;
+            std::deque<Job> jobs;
+        };
+
+        std::vector<Queue> queues;
+
+        bool take(std::size_t worker, Job& job)
+        {
+            {
+                auto& own = queues[worker];
+                const std::lock_guard<std::mutex> sl(own.lock);
+                if (!own.jobs.empty())
+                {
+                    job = std::move(own.jobs.front());
+                    own.jobs.pop_front();
+                    return true;
+                }
+            }
+
+            // no job is ever added, so one empty pass over the others means we're done
+            for (std::size_t i = 1; i < queues.size(); ++i)
+            {
+                auto& victim = queues[(worker + i) % queues.size()];
+                const std::lock_guard<std::mutex> sl(victim.lock);
+                if (!victim.jobs.empty())
+                {
+                    job = std::move(victim.jobs.back());
+                    victim.jobs.pop_back();
+                    return true;
+                }
+            }
+
+            return false;
+        }
+    };
+
+    bool isMidiFile(const fs::path& file)
+    {
+        const auto extension = file.extension().string();
+        return extension == ".mid" || extension == ".midi" || extension == ".MID" || extension == ".MIDI";
+    }
+
+    fs::path retunedName(const fs::path& file)
+    {
+        return file.parent_path() / (file.stem().string() + "-retuned" + file.extension().string());
+    }
+
+    void addJobs(const fs::path& input, const fs::path& outputDirectory, std::vector<Job>& jobs)
+    {
+        std::error_code ec;
+
+        if (!fs::is_directory(input, ec))
+        {
+            jobs.push_back({ input, outputDirectory.empty() ? retunedName(input) : outputDirectory / input.filename() });
+            return;
+        }
+
+        for (auto& entry : fs::recursive_directory_iterator(input, ec))
+        {
+            if (!entry.is_regular_file() || !isMidiFile(entry.path()))
+                continue;
+
+            // don't retune our own output twice
+            if (outputDirectory.empty() && entry.path().stem().string().size() > 8
+                && entry.path().stem().string().compare(entry.path().stem().string().size() - 8, 8, "-retuned") == 0)
+                continue;
+
+            const auto relative = fs::relative(entry.path(), input, ec);
+            jobs.push_back({ entry.path(), outputDirectory.empty() ? retunedName(entry.path()) : outputDirectory / relative });
+        }
+    }
+
+    int bendRangeIndexFor(int semitones)
+    {
+        for (std::size_t i = 0; i < PitchBend::ranges.size(); ++i)
+            if (PitchBend::ranges[i] == semitones)
+                return (int) i;
+        return -1;
+    }
+
+    int usage(const char* name)
+    {
+        std::fprintf(stderr, "usage: %s --scale file [--track n=file ...] [--bend-range semitones] [--exclusive]\n"
+                             "       [--threads n] [--output directory] <file.mid | directory> ...\n", name);
+        return 2;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    std::vector<fs::path> inputs;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "--scale" && hasValue)
+        {
+            if ((options.scale = ScaleDirectory::load(argv[++i])) == nullptr)
+                return 1;
+        }
+        else if (arg == "--track" && hasValue)
+        {
+            const std::string mapping = argv[++i];
+            const auto separator = mapping.find('=');
+            if (separator == std::string::npos)
+                return usage(argv[0]);
+
+            auto table = ScaleDirectory::load(mapping.substr(separator + 1));
+            if (table == nullptr)
+                return 1;
+            options.trackScales[std::atoi(mapping.substr(0, separator).c_str())] = std::move(table);
+        }
+        else if (arg == "--bend-range" && hasValue)
+        {
+            if ((options.bendRangeIndex = bendRangeIndexFor(std::atoi(argv[++i]))) < 0)
+            {
+                std::fprintf(stderr, "--bend-range must be one of 1, 2, 3, 4, 7, 12, 24, 48\n");
+                return 2;
+            }
+        }
+        else if (arg == "--exclusive")
+            options.exclusive = true;
+        else if (arg == "--threads" && hasValue)
+            options.numThreads = (unsigned) std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--output" && hasValue)
+            options.output = argv[++i];
+        else if (!arg.empty() && arg[0] != '-')
+            inputs.push_back(arg);
+        else
+            return usage(argv[0]);
+    }
+
+    if (options.scale == nullptr || inputs.empty())
+        return usage(argv[0]);
+
+    std::vector<Job> jobs;
+    for (auto& input : inputs)
+        addJobs(input, options.output, jobs);
+
+    Totals totals;
+    const auto start = std::chrono::steady_clock::now();
+
+    WorkStealingPool pool(std::move(jobs), options.numThreads);
+    pool.run([&](const Job& job) {
+        const auto n = retuneFile(job, options);
+
+        if (n < 0)
+        {
+            ++totals.failures;
+            return;
+        }
+
+        std::error_code ec;
+        totals.events += (unsigned long long) n;
+        totals.bytes += (unsigned long long) fs::file_size(job.input, ec);
+        ++totals.files;
+    });
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("%d files, %llu events, %.1f MB in %.3f s: %.0f events/s, %.1f MB/s, %u threads\n",
+                totals.files.load(), totals.events.load(), (double) totals.bytes.load() / 1e6, seconds,
+                seconds > 0 ? (double) totals.events.load() / seconds : 0.0,
+                seconds > 0 ? (double) totals.bytes.load() / 1e6 / seconds : 0.0, options.numThreads);
+
+    if (totals.failures > 0)
+        std::fprintf(stderr, "%d files failed\n", totals.failures.load());
+
+    return totals.failures == 0 ? 0 : 1;
+}